@@ -0,0 +1,96 @@
+#include "ConcurrentMemoryPool.h"
+
+#include <iostream>
+#include <algorithm>
+#include <functional>
+
+#ifdef WIN32
+#include <windows.h>
+#endif //WIN32
+
+#ifdef __linux__
+#include <sched.h>
+#endif //__linux__
+
+namespace mem
+{
+    ConcurrentMemoryPool::ConcurrentMemoryPool(u64 pageSize, u32 countShards, MemoryPool::MemoryAllocator* allocator, bool deleteUnusedPools, void* user) noexcept
+    {
+        if (countShards == 0)
+        {
+            countShards = std::max<u32>(1, std::thread::hardware_concurrency());
+        }
+
+        m_shards.reserve(countShards);
+        m_shardOfPool.reserve(countShards);
+        for (u32 i = 0; i < countShards; ++i)
+        {
+            Shard* shard = m_shards.emplace_back(std::make_unique<Shard>(pageSize, allocator, deleteUnusedPools, user)).get();
+            m_shardOfPool.emplace(&shard->_pool, shard);
+        }
+        m_largeShard = std::make_unique<Shard>(pageSize, allocator, deleteUnusedPools, user);
+    }
+
+    ConcurrentMemoryPool::~ConcurrentMemoryPool()
+    {
+        m_shards.clear();
+        m_largeShard.reset();
+    }
+
+    address_ptr ConcurrentMemoryPool::allocMemory(u64 size, u32 aligment)
+    {
+        Shard* shard = m_largeShard->_pool.isLargeAllocation(size, aligment) ? m_largeShard.get() : ConcurrentMemoryPool::selectShard();
+
+        std::lock_guard<std::mutex> lock(shard->_mutex);
+        return shard->_pool.allocMemory(size, aligment);
+    }
+
+    void ConcurrentMemoryPool::freeMemory(address_ptr memory)
+    {
+        MemoryPool* pool = m_largeShard->_pool.getMemoryPool(memory);
+        Shard* shard = m_largeShard.get();
+        if (pool)
+        {
+            auto found = m_shardOfPool.find(pool);
+            assert(found != m_shardOfPool.cend() && "memory is not from this pool");
+            shard = found->second;
+        }
+
+        std::lock_guard<std::mutex> lock(shard->_mutex);
+        shard->_pool.freeMemoryLocal(memory);
+    }
+
+    u32 ConcurrentMemoryPool::getCountShards() const
+    {
+        return static_cast<u32>(m_shards.size());
+    }
+
+    void ConcurrentMemoryPool::collectStatistic()
+    {
+        for (u32 i = 0; i < m_shards.size(); ++i)
+        {
+            std::cout << "Shard " << i << std::endl;
+
+            std::lock_guard<std::mutex> lock(m_shards[i]->_mutex);
+            m_shards[i]->_pool.collectStatistic();
+        }
+
+        std::cout << "Large Shard" << std::endl;
+        std::lock_guard<std::mutex> lock(m_largeShard->_mutex);
+        m_largeShard->_pool.collectStatistic();
+    }
+
+    ConcurrentMemoryPool::Shard* ConcurrentMemoryPool::selectShard() const
+    {
+#if defined(WIN32)
+        u64 index = ::GetCurrentProcessorNumber();
+#elif defined(__linux__)
+        s32 cpu = sched_getcpu();
+        u64 index = (cpu >= 0) ? static_cast<u64>(cpu) : std::hash<std::thread::id>()(std::this_thread::get_id());
+#else
+        u64 index = std::hash<std::thread::id>()(std::this_thread::get_id());
+#endif
+        return m_shards[index % m_shards.size()].get();
+    }
+
+} //namespace mem
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "MemoryPool.h"
+
+#include <memory>
+#include <unordered_map>
+
+namespace mem
+{
+    /*
+    * class ConcurrentMemoryPool. Thread safe memory pool
+    * Owns a MemoryPool shard per core, a shard is picked by the current CPU (thread id if not available)
+    * Memory is returned to the shard allocated it, large allocations are served by a separate shard
+    */
+    class ConcurrentMemoryPool final
+    {
+    public:
+
+        ConcurrentMemoryPool(const ConcurrentMemoryPool&) = delete;
+        ConcurrentMemoryPool& operator=(const ConcurrentMemoryPool&) = delete;
+
+        /*
+        * ConcurrentMemoryPool constuctor
+        * param pageSize : page size (best size 65KB, but no more)
+        * param countShards : count of shards, 0 - count of hardware threads
+        * param allocator: allocator, must be thread safe
+        * param user: user data
+        */
+        explicit ConcurrentMemoryPool(u64 pageSize, u32 countShards = 0, MemoryPool::MemoryAllocator* allocator = MemoryPool::getDefaultMemoryAllocator(), bool deleteUnusedPools = true, void* user = nullptr) noexcept;
+
+        /*
+        * ~ConcurrentMemoryPool destuctor
+        */
+        ~ConcurrentMemoryPool();
+
+        /*
+        * Request free memory from pool
+        * param size: count bytes will be requested
+        * param aligment: aligment
+        */
+        address_ptr allocMemory(u64 size, u32 aligment = 0);
+
+        template<class T>
+        T* allocElement()
+        {
+            return reinterpret_cast<T*>(allocMemory(sizeof(T), alignof(T)));
+        }
+
+        template<class T>
+        T* allocArray(u64 count)
+        {
+            return reinterpret_cast<T*>(allocMemory(sizeof(T) * count, alignof(T)));
+        }
+
+        /*
+        * Return memory to pool
+        * param address_ptr: address of memory
+        */
+        void freeMemory(address_ptr memory);
+
+        u32 getCountShards() const;
+
+        void collectStatistic();
+
+    private:
+
+        struct alignas(64) Shard
+        {
+            Shard(u64 pageSize, MemoryPool::MemoryAllocator* allocator, bool deleteUnusedPools, void* user) noexcept
+                : _pool(pageSize, allocator, deleteUnusedPools, user)
+            {
+            }
+
+            MemoryPool  _pool;
+            std::mutex  _mutex;
+        };
+
+        Shard* selectShard() const;
+
+        std::vector<std::unique_ptr<Shard>>             m_shards;
+        std::unique_ptr<Shard>                          m_largeShard;
+        std::unordered_map<const MemoryPool*, Shard*>   m_shardOfPool; //filled by the constructor, read only after
+    };
+
+} //namespace mem
@@ -0,0 +1,152 @@
+#include "FrameArena.h"
+
+namespace mem
+{
+    FrameArena::FrameArena(MemoryPool& pool, u64 chunkSize) noexcept
+        : m_pool(pool)
+        , k_chunkSize(chunkSize)
+        , m_first(nullptr)
+        , m_chunk(nullptr)
+        , m_current(0)
+        , m_end(0)
+    {
+        assert(k_chunkSize > sizeof(Chunk));
+    }
+
+    FrameArena::~FrameArena()
+    {
+        FrameArena::release();
+    }
+
+    address_ptr FrameArena::allocateFromNextChunk(u64 size, u64 aligment)
+    {
+        //worst case padding of the chunk start
+        u64 requiredSize = sizeof(Chunk) + aligment + size;
+
+        //first spare chunk that fits
+        Chunk* next = m_chunk ? m_chunk->_next : m_first;
+        Chunk* chunk = next;
+        while (chunk && chunk->_size < requiredSize)
+        {
+            chunk = chunk->_next;
+        }
+
+        if (chunk != next || !chunk)
+        {
+            if (chunk)
+            {
+                //unlink the spare chunk, it goes right after the current one
+                chunk->_prev->_next = chunk->_next;
+                if (chunk->_next)
+                {
+                    chunk->_next->_prev = chunk->_prev;
+                }
+            }
+            else
+            {
+                u64 chunkSize = (requiredSize > k_chunkSize) ? requiredSize : k_chunkSize;
+                chunk = reinterpret_cast<Chunk*>(m_pool.allocMemory(chunkSize));
+                assert(chunk);
+                chunk->_size = chunkSize;
+            }
+
+            chunk->_prev = m_chunk;
+            chunk->_next = next;
+            if (next)
+            {
+                next->_prev = chunk;
+            }
+
+            if (m_chunk)
+            {
+                m_chunk->_next = chunk;
+            }
+            else
+            {
+                m_first = chunk;
+            }
+        }
+
+        FrameArena::setChunk(chunk);
+
+        u64 address = (m_current + aligment - 1) & ~(aligment - 1);
+        assert(address + size <= m_end);
+        m_current = address + size;
+
+        return reinterpret_cast<address_ptr>(address);
+    }
+
+    void FrameArena::setChunk(Chunk* chunk)
+    {
+        m_chunk = chunk;
+        m_current = reinterpret_cast<u64>(chunk) + sizeof(Chunk);
+        m_end = reinterpret_cast<u64>(chunk) + chunk->_size;
+    }
+
+    void FrameArena::rewind(const Mark& mark)
+    {
+        if (!mark._chunk)
+        {
+            FrameArena::reset();
+            return;
+        }
+
+        Chunk* chunk = reinterpret_cast<Chunk*>(mark._chunk);
+        assert(mark._current >= reinterpret_cast<u64>(chunk) + sizeof(Chunk) && mark._current <= reinterpret_cast<u64>(chunk) + chunk->_size);
+        m_chunk = chunk;
+        m_current = mark._current;
+        m_end = reinterpret_cast<u64>(chunk) + chunk->_size;
+    }
+
+    void FrameArena::reset()
+    {
+        if (m_first)
+        {
+            FrameArena::setChunk(m_first);
+        }
+    }
+
+    void FrameArena::release()
+    {
+        Chunk* chunk = m_first;
+        while (chunk)
+        {
+            Chunk* next = chunk->_next;
+            m_pool.freeMemory(chunk);
+            chunk = next;
+        }
+
+        m_first = nullptr;
+        m_chunk = nullptr;
+        m_current = 0;
+        m_end = 0;
+    }
+
+    u64 FrameArena::getUsedSize() const
+    {
+        if (!m_chunk)
+        {
+            return 0;
+        }
+
+        u64 size = m_current - reinterpret_cast<u64>(m_chunk);
+        for (Chunk* chunk = m_chunk->_prev; chunk; chunk = chunk->_prev)
+        {
+            size += chunk->_size;
+        }
+
+        return size;
+    }
+
+    u64 FrameArena::getReservedSize() const
+    {
+        u64 size = 0;
+        for (Chunk* chunk = m_first; chunk; chunk = chunk->_next)
+        {
+            size += chunk->_size;
+        }
+
+        return size;
+    }
+
+} //namespace mem
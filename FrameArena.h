@@ -0,0 +1,123 @@
+#pragma once
+
+#include "MemoryPool.h"
+
+namespace mem
+{
+    /*
+    * class FrameArena. Linear allocator for scratch memory that dies all at once
+    * Memory is bumped from chunks taken from a MemoryPool, blocks have no headers and are never freed one by one.
+    * mark()/rewind() give nested scopes, chunks are kept for reuse until release(). Not thread safe
+    */
+    class FrameArena final
+    {
+    public:
+
+        FrameArena(const FrameArena&) = delete;
+        FrameArena& operator=(const FrameArena&) = delete;
+
+        static constexpr u64 k_defaultChunkSize = MemoryPool::k_mixSizePageSize;
+
+        /*
+        * Position of the arena, allocations made after it are dropped by rewind
+        */
+        struct Mark
+        {
+            void*   _chunk;
+            u64     _current;
+        };
+
+        /*
+        * FrameArena constuctor
+        * param pool: source of the chunks
+        * param chunkSize: size of a chunk, bigger requests take own chunk
+        */
+        explicit FrameArena(MemoryPool& pool, u64 chunkSize = k_defaultChunkSize) noexcept;
+
+        /*
+        * ~FrameArena destuctor, returns all chunks to the pool
+        */
+        ~FrameArena();
+
+        /*
+        * Request memory from the current chunk
+        * param size: count bytes will be requested
+        * param aligment: aligment, power of two. 0 - alignof(std::max_align_t)
+        */
+        address_ptr allocMemory(u64 size, u32 aligment = 0)
+        {
+            assert(size);
+            u64 align = (aligment > k_defaultAligment) ? aligment : k_defaultAligment;
+            u64 address = (m_current + align - 1) & ~(align - 1);
+            if (address + size <= m_end)
+            {
+                m_current = address + size;
+                return reinterpret_cast<address_ptr>(address);
+            }
+
+            return FrameArena::allocateFromNextChunk(size, align);
+        }
+
+        template<class T>
+        T* allocElement()
+        {
+            return reinterpret_cast<T*>(allocMemory(sizeof(T), alignof(T)));
+        }
+
+        template<class T>
+        T* allocArray(u64 count)
+        {
+            return reinterpret_cast<T*>(allocMemory(sizeof(T) * count, alignof(T)));
+        }
+
+        Mark mark() const
+        {
+            return { m_chunk, m_current };
+        }
+
+        /*
+        * Drop allocations made after the mark, marks taken after it become invalid
+        */
+        void rewind(const Mark& mark);
+
+        /*
+        * Drop all allocations, chunks are kept
+        */
+        void reset();
+
+        /*
+        * Drop all allocations and return chunks to the pool
+        */
+        void release();
+
+        /*
+        * Bytes of the chunks before the current position, the tails of left chunks are counted as used
+        */
+        u64 getUsedSize() const;
+        u64 getReservedSize() const;
+
+    private:
+
+        struct Chunk
+        {
+            Chunk*  _prev;
+            Chunk*  _next;
+            u64     _size;
+        };
+
+        static constexpr u64 k_defaultAligment = alignof(std::max_align_t);
+
+        address_ptr allocateFromNextChunk(u64 size, u64 aligment);
+        void setChunk(Chunk* chunk);
+
+        MemoryPool&     m_pool;
+        const u64       k_chunkSize;
+
+        //chunks are ordered by use, the ones after the current are empty and reused before new are taken
+        Chunk*          m_first;
+        Chunk*          m_chunk;
+        u64             m_current;
+        u64             m_end;
+    };
+
+} //namespace mem
@@ -6,8 +6,19 @@
 #include <algorithm>
 #include <iostream>
 #include <stdlib.h>
+#include <cstring>
 #include <type_traits>
 
+#ifdef _MSC_VER
+#   include <intrin.h>
+#   include <malloc.h>
+#endif //_MSC_VER
+
+#ifdef __linux__
+#   include <sys/mman.h>
+#   include <unistd.h>
+#endif //__linux__
+
 #ifdef new
 #   undef new
 #endif
@@ -28,7 +39,7 @@ namespace mem
 {
     enum
     {
-        DEFAULT_ALIGMENT = 4,
+        DEFAULT_ALIGMENT = alignof(std::max_align_t),
 
         MIN_ALIGMENT = 4,
         MAX_ALIGMENT = 16,
@@ -40,58 +51,183 @@ namespace mem
         return (val + alignment - 1) & ~(alignment - 1);
     }
 
-    static std::vector<u16> s_smallBlockTableSizes =
+    template<class T>
+    inline T alignDown(T val, T alignment)
     {
-        16, 32, 48, 64, 80, 96, 112, 128,
-        160, 192, 224, 256, 288, 320, 384, 448,
-        512, 576, 640, 704, 768, 896, 1024, 1168,
-        1360, 1632, 2048, 2336, 2720, 3264, 4096, 4368,
-        4672, 5040, 5456, 5952, 6544, 7280, 8192, 9360,
-        10912, 13104, 16384, 21840, 32768
-    };
+        return val & ~(alignment - 1);
+    }
+
+    inline u32 bitScanForward(u64 val)
+    {
+        assert(val);
+#if defined(_MSC_VER)
+        unsigned long index = 0;
+        _BitScanForward64(&index, val);
+        return static_cast<u32>(index);
+#else
+        return static_cast<u32>(__builtin_ctzll(val));
+#endif
+    }
+
+    inline u32 bitScanReverse(u64 val)
+    {
+        assert(val);
+#if defined(_MSC_VER)
+        unsigned long index = 0;
+        _BitScanReverse64(&index, val);
+        return static_cast<u32>(index);
+#else
+        return 63 - static_cast<u32>(__builtin_clzll(val));
+#endif
+    }
+
+    inline u64 getTimeMilliseconds()
+    {
+        return static_cast<u64>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
 
     MemoryPool::MemoryAllocator* MemoryPool::s_defaultMemoryAllocator = nullptr;
 
-    MemoryPool::MemoryPool(u64 pageSize, MemoryAllocator* allocator, bool deleteUnusedPools, void* user) noexcept
+    MemoryPool::SizeClassIndex::SizeClassIndex() noexcept
+    {
+        assert(k_smallBlockTableSizes.size() + k_cacheLineTableSizes.size() <= std::numeric_limits<u16>::max());
+        u32 blockIndex = 0;
+        auto blockIter = k_smallBlockTableSizes.cbegin();
+        for (u64 i = 0; i < _smallTableIndex.size(); ++i)
+        {
+            u64 blockSize = (u64)((i + 1U) << 2U);
+            while (blockIter != k_smallBlockTableSizes.cend() && *blockIter < blockSize)
+            {
+                ++blockIndex;
+                blockIter = std::next(blockIter);
+            }
+            _smallTableIndex[i] = blockIndex;
+        }
+
+        //cache line tables are after the default ones
+        blockIndex = static_cast<u32>(k_smallBlockTableSizes.size());
+        blockIter = k_cacheLineTableSizes.cbegin();
+        for (u64 i = 0; i < _cacheLineTableIndex.size(); ++i)
+        {
+            u64 blockSize = (i + 1) * k_cacheLineSize;
+            while (*blockIter < blockSize)
+            {
+                ++blockIndex;
+                blockIter = std::next(blockIter);
+            }
+            _cacheLineTableIndex[i] = blockIndex;
+        }
+    }
+
+    const MemoryPool::SizeClassIndex& MemoryPool::getSizeClassIndex()
+    {
+        static const SizeClassIndex s_sizeClassIndex;
+        return s_sizeClassIndex;
+    }
+
+    MemoryPool::MemoryPool(u64 pageSize, MemoryAllocator* allocator, bool deleteUnusedPools, void* user, SmallTableLayout layout) noexcept
         : m_allocator(allocator)
         , m_userData(user)
+        , m_sizeClassIndex(MemoryPool::getSizeClassIndex())
         , k_pageSize(pageSize)
         , k_maxSizePoolAllocation(pageSize)
+        , k_poolSize(pageSize * k_countPagesPerAllocation)
+
+        , m_largeCacheLimit(k_defaultLargeCacheLimit)
+        , m_largeCacheDecay(k_defaultLargeCacheDecay)
+        , m_largeCachedSize(0)
+        , m_largeCacheNextDecay(0)
+        , m_largeCacheStatistic()
+
+        , m_ownerThread(std::this_thread::get_id())
+        , m_remoteLargeFree(nullptr)
+
+        , m_region(nullptr)
+        , m_regionSize(0)
+        , m_regionSpan(nullptr)
+        , m_regionSpanSize(0)
+        , m_regionShift(0)
+        , m_regionCarvedSlots(0)
+
+        , m_parent(nullptr)
+        , m_countHeaps(0)
+        , m_heapSupplySize(0)
+
+        , m_poolsSize(0)
+        , m_largeSize(0)
+        , m_memoryBudget(0)
+        , m_budgetCallback(nullptr)
+        , m_budgetUser(nullptr)
+        , m_overBudget(false)
 
         , k_deleteUnusedPools(deleteUnusedPools)
+        , k_smallTableLayout(layout)
     {
         assert(k_pageSize >= k_mixSizePageSize);
-        m_smallTableIndex.fill(0);
-        m_smallPoolTables.resize(s_smallBlockTableSizes.size());
+        assert(k_poolSize <= std::numeric_limits<u32>::max() && "medium block size is 32 bit");
+        assert((k_smallTableLayout != SmallTableLayout::AlignedSlab || (k_poolSize & (k_poolSize - 1)) == 0) && "pool size must be power of two");
+        static_assert(sizeof(Block) % DEFAULT_ALIGMENT == 0 && sizeof(MediumBlock) % DEFAULT_ALIGMENT == 0, "user memory must stay aligned");
+        m_smallPoolTables.resize(k_smallBlockTableSizes.size() + k_cacheLineTableSizes.size());
+
+        PoolTable::Type smallTableType = PoolTable::SmallTable;
+        if (k_smallTableLayout == SmallTableLayout::Slab)
+        {
+            smallTableType = PoolTable::SlabTable;
+        }
+        else if (k_smallTableLayout == SmallTableLayout::AlignedSlab)
+        {
+            smallTableType = PoolTable::AlignedSlabTable;
+        }
 
         u32 blockIndex = 0;
-        auto blockIter = s_smallBlockTableSizes.cbegin();
-        for (u64 i = 0; i < (k_maxSizeSmallTableAllocation >> 2); ++i)
+        for (u16 size : k_smallBlockTableSizes)
         {
-            u64 blockSize = (u64)((i + 1U) << 2U);
-            while (blockIter != s_smallBlockTableSizes.cend() && *blockIter < blockSize)
-            {
-                ++blockIndex;
-                blockIter = std::next(blockIter);
-            }
+            m_smallPoolTables[blockIndex]._memoryPool = this;
+            m_smallPoolTables[blockIndex]._size = static_cast<u64>(size);
+            m_smallPoolTables[blockIndex]._type = smallTableType;
+            ++blockIndex;
+        }
 
-            m_smallTableIndex[i] = blockIndex;
-            m_smallPoolTables[blockIndex]._size = static_cast<u64>(*blockIter);
-            m_smallPoolTables[blockIndex]._type = PoolTable::SmallTable;
+        //cache line tables are slabs in any layout
+        for (u16 size : k_cacheLineTableSizes)
+        {
+            m_smallPoolTables[blockIndex]._memoryPool = this;
+            m_smallPoolTables[blockIndex]._size = static_cast<u64>(size);
+            m_smallPoolTables[blockIndex]._type = PoolTable::CacheLineTable;
+            ++blockIndex;
         }
 
-        m_poolTable._size = alignUp<u64>(k_maxSizePoolAllocation * k_countPagesPerAllocation, DEFAULT_ALIGMENT);
+        m_poolTable._memoryPool = this;
+        m_poolTable._size = k_poolSize;
 
         //pre init
         //MemoryPool::preAllocatePools()
-
-        m_markedToDelete.reserve(32);
     }
 
     MemoryPool::~MemoryPool()
     {
         MemoryPool::reset();
         MemoryPool::clear();
+        if (m_region)
+        {
+            m_allocator->deallocate(m_regionSpan, m_regionSpanSize, m_userData);
+            m_region = nullptr;
+        }
+
+        assert(m_countHeaps.load() == 0 && "heaps must be destroyed before the parent");
+        for (HeapSpan& heapSpan : m_heapSupply)
+        {
+            if (heapSpan._span == heapSpan._memory)
+            {
+                MemoryPool::deallocateSpan(heapSpan._span, heapSpan._spanSize);
+            }
+            else
+            {
+                m_allocator->deallocate(heapSpan._span, heapSpan._spanSize, m_userData);
+            }
+        }
+        m_heapSupply.clear();
+        m_heapSupplySize.store(0, std::memory_order_relaxed);
         m_userData = nullptr;
     }
 
@@ -101,23 +237,33 @@ namespace mem
         auto startTime = std::chrono::high_resolution_clock::now();
 #endif //ENABLE_STATISTIC
         assert(size);
-        if (aligment == 0) //default
+        if (aligment <= DEFAULT_ALIGMENT) //default
         {
             aligment = DEFAULT_ALIGMENT;
         }
+        assert((aligment & (aligment - 1)) == 0 && "aligment must be power of two");
+
+        u32 tableIndex = MemoryPool::getSmallTableIndex(size, aligment);
+        if (tableIndex == k_invalidTableIndex && aligment != DEFAULT_ALIGMENT)
+        {
+            //aligned pointer inside a bigger small/medium block
+            if (u64 allocationSize = MemoryPool::getAlignedAllocationSize(size, aligment); allocationSize <= k_maxSizePoolAllocation)
+            {
+                return MemoryPool::alignBlockMemory(MemoryPool::allocMemory(allocationSize), aligment);
+            }
+        }
 
         u32 aligmentedSize = alignUp<u32>(static_cast<u32>(size), aligment);
-        if (aligmentedSize <= k_maxSizeSmallTableAllocation && aligment == DEFAULT_ALIGMENT)
+        if (tableIndex != k_invalidTableIndex)
         {
             //small allocations
-            Block* block = allocateFromSmallTables(aligmentedSize);
-            assert(block);
-            address_ptr ptr = block->ptr();
+            address_ptr ptr = allocateFromSmallTable(tableIndex);
+            assert(ptr);
 #if ENABLE_STATISTIC
             auto endTime = std::chrono::high_resolution_clock::now();
             m_statistic._allocateTime += std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
 
-            m_statistic.registerAllocation<0>(block->_size);
+            m_statistic.registerAllocation<0>(MemoryPool::getPool(ptr)->slotSize());
 #endif //ENABLE_STATISTIC
 
             return ptr;
@@ -125,14 +271,14 @@ namespace mem
         else if (aligmentedSize <= k_maxSizePoolAllocation && aligment == DEFAULT_ALIGMENT)
         {
             //pool allocation
-            Block* block = allocateFromTable(aligmentedSize);
+            MediumBlock* block = allocateFromTable(aligmentedSize);
             assert(block);
             address_ptr ptr = block->ptr();
 #if ENABLE_STATISTIC
             auto endTime = std::chrono::high_resolution_clock::now();
             m_statistic._allocateTime += std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
 
-            m_statistic.registerAllocation<1>(block->_size);
+            m_statistic.registerAllocation<1>(block->size());
 #endif //ENABLE_STATISTIC
 
             return ptr;
@@ -140,19 +286,77 @@ namespace mem
         else
         {
             //large allocation
-            u64 allocationSize = alignUp<u64>(aligmentedSize + sizeof(Block), aligment);
-            address_ptr memory = m_allocator->allocate(allocationSize, aligment, m_userData);
-            assert(memory);
+            if (m_remoteLargeFree.load(std::memory_order_relaxed))
+            {
+                MemoryPool::drainRemoteLargeFree();
+            }
+
+            Block* block = nullptr;
+            u64 allocationSize = 0;
+            if (k_smallTableLayout == SmallTableLayout::AlignedSlab)
+            {
+                //pool header without table marks a large allocation for the address mask
+                assert(aligment <= k_poolSize && "aligment is bigger than the pool size");
+                u64 headerSize = alignUp<u64>(sizeof(Pool) + sizeof(Block), aligment);
+                allocationSize = alignUp<u64>(aligmentedSize + headerSize, aligment);
+
+                address_ptr span = nullptr;
+                u64 spanSize = 0;
+                address_ptr memory = MemoryPool::acquireLargeCache(allocationSize, span, spanSize);
+                if (!memory)
+                {
+                    MemoryPool::checkMemoryBudget(allocationSize);
+                    memory = MemoryPool::allocateAlignedSpan(allocationSize, span, spanSize);
+#if ENABLE_STATISTIC
+                    m_statistic.registerPoolAllocation<2>(allocationSize);
+#endif //ENABLE_STATISTIC
+                }
+                assert(memory);
+
+                Pool* header = new(memory) Pool(nullptr, 0, allocationSize);
+                header->_span = span;
+                header->_spanSize = spanSize;
+                block = initBlock(reinterpret_cast<address_ptr>(reinterpret_cast<u64>(memory) + headerSize - sizeof(Block)), nullptr, allocationSize);
+            }
+            else
+            {
+                //the user memory right after the header is aligned
+                u64 headerSize = alignUp<u64>(sizeof(Block), aligment);
+                allocationSize = alignUp<u64>(aligmentedSize + headerSize, aligment);
+
+                //cache keeps only allocations without the aligment gap
+                address_ptr span = nullptr;
+                u64 spanSize = 0;
+                address_ptr memory = (headerSize == sizeof(Block)) ? MemoryPool::acquireLargeCache(allocationSize, span, spanSize) : nullptr;
+                if (!memory)
+                {
+                    MemoryPool::checkMemoryBudget(allocationSize);
+                    memory = m_allocator->allocate(allocationSize, aligment, m_userData);
+#if ENABLE_STATISTIC
+                    m_statistic.registerPoolAllocation<2>(allocationSize);
+#endif //ENABLE_STATISTIC
+                }
+                assert(memory);
 
-            Block* block = initBlock(memory, nullptr, allocationSize);
+                u64 gap = headerSize - sizeof(Block);
+                block = initBlock(reinterpret_cast<address_ptr>(reinterpret_cast<u64>(memory) + gap), nullptr, allocationSize | ((gap > 0) ? Block::k_alignedGapBit : 0));
+                if (gap > 0)
+                {
+                    *reinterpret_cast<address_ptr*>(reinterpret_cast<u64>(block) - sizeof(address_ptr)) = memory;
+                }
+            }
             m_largeAllocations.insert(block);
+            m_largeSize += allocationSize;
+            if (m_region)
+            {
+                m_regionLargeAllocations.insert(block->ptr());
+            }
 
 #if ENABLE_STATISTIC
             auto endTime = std::chrono::high_resolution_clock::now();
             m_statistic._allocateTime += std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
 
             m_statistic.registerAllocation<2>(allocationSize);
-            m_statistic.registerPoolAllocation<2>(allocationSize);
 #endif //ENABLE_STATISTIC
 
             address_ptr ptr = block->ptr();
@@ -165,461 +369,2519 @@ namespace mem
 
     void MemoryPool::freeMemory(address_ptr memory)
     {
-#if ENABLE_STATISTIC
-        auto startTime = std::chrono::high_resolution_clock::now();
-#endif //ENABLE_STATISTIC
-        address_ptr ptr = reinterpret_cast<address_ptr>(reinterpret_cast<u64>(memory) - sizeof(Block));
-        
-        Block* block = reinterpret_cast<Block*>(ptr);
-        assert(block);
-        if (block->_pool)
+        if (Pool* pool = MemoryPool::getPool(memory); pool)
         {
-            freeBlock(block);
+            if (pool->_owner != std::this_thread::get_id())
+            {
+                PoolTable* table = const_cast<PoolTable*>(pool->_table);
+                table->_remoteFreeCount.fetch_add(1, std::memory_order_relaxed);
+                MemoryPool::pushRemoteFree(pool->_remoteFree, memory);
+
+                return;
+            }
         }
-        else
+        else if (m_ownerThread != std::this_thread::get_id())
         {
-            assert(!m_largeAllocations.empty() && "empty");
-            m_largeAllocations.erase(block);
+            MemoryPool::pushRemoteFree(m_remoteLargeFree, memory);
 
-            u64 blockSize = block->_size;
-            m_allocator->deallocate(ptr, blockSize, m_userData);
-#if ENABLE_STATISTIC
-            m_statistic.registerDeallocation<2>(blockSize);
-            m_statistic.registerPoolDeallocation<2>(blockSize);
-#endif //ENABLE_STATISTIC
+            return;
         }
 
-#if ENABLE_STATISTIC
-        auto endTime = std::chrono::high_resolution_clock::now();
-        m_statistic._dealocateTime += std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
-#endif //ENABLE_STATISTIC
+        MemoryPool::freeMemoryLocal(memory);
     }
 
-    void MemoryPool::preAllocatePools()
+    void MemoryPool::freeMemory(address_ptr memory, u64 size)
     {
-        for (auto& table : m_smallPoolTables)
+        //small and medium blocks, large allocations with a big aligment go the common way
+        if (size <= k_maxSizePoolAllocation)
         {
-            assert(table._activePools.empty());
-            Pool* pool = MemoryPool::allocateFixedBlocksPool(&table, DEFAULT_ALIGMENT);
-            table._activePools.insert(pool);
+            if (Pool* pool = MemoryPool::getPool(memory); pool && pool->_owner == std::this_thread::get_id())
+            {
+                MemoryPool::freePoolMemory(pool, memory);
+                return;
+            }
         }
+
+        MemoryPool::freeMemory(memory);
     }
 
-    void MemoryPool::reset()
+    u32 MemoryPool::getSizeClass(u64 size, u32 aligment) const
     {
-        //small tables
-        for (auto& table : m_smallPoolTables)
+        assert(size);
+        if (aligment <= DEFAULT_ALIGMENT) //default
         {
-            {
-                auto pool = table._activePools.begin();
-                while (pool != table._activePools.end())
-                {
-                    pool->reset();
-                    pool = pool->_next;
-                }
-            }
+            aligment = DEFAULT_ALIGMENT;
+        }
 
-            {
-                auto pool = table._fullPools.begin();
-                while (pool != table._fullPools.end())
-                {
-                    pool->reset();
+        static_assert(k_invalidSizeClass == k_invalidTableIndex, "size class is the small table index");
+        return MemoryPool::getSmallTableIndex(size, aligment);
+    }
+
+    address_ptr MemoryPool::allocFromSizeClass(u32 sizeClass)
+    {
+        assert(sizeClass < m_smallPoolTables.size());
+        address_ptr ptr = MemoryPool::allocateFromSmallTable(sizeClass);
+        assert(ptr);
+#if ENABLE_STATISTIC
+        m_statistic.registerAllocation<0>(MemoryPool::getPool(ptr)->slotSize());
+#endif //ENABLE_STATISTIC
 
-                    Pool* nextPool = pool->_next;
-                    table._activePools.insert(pool);
+        return ptr;
+    }
 
-                    pool = nextPool;
-                }
-            }
+    address_ptr MemoryPool::reallocMemory(address_ptr memory, u64 size)
+    {
+        if (!memory)
+        {
+            return MemoryPool::allocMemory(size);
         }
+        assert(size);
 
-        //medium table
+        u64 aligmentedSize = alignUp<u64>(size, DEFAULT_ALIGMENT);
+        Pool* pool = MemoryPool::getPool(memory);
+        if (pool && pool->_owner == std::this_thread::get_id() && MemoryPool::getBlockMemory(pool, memory) == memory)
         {
+            if (pool->_table->_type != PoolTable::Default)
             {
-                auto pool = m_poolTable._activePools.begin();
-                while (pool != m_poolTable._activePools.end())
+                //small block, size class fits
+                if (aligmentedSize <= pool->_blockSize)
                 {
-                    pool->reset();
-                    pool = pool->_next;
+                    return memory;
                 }
             }
-
+            else if (aligmentedSize <= k_maxSizePoolAllocation)
             {
-                auto pool = m_poolTable._fullPools.begin();
-                while (pool != m_poolTable._fullPools.end())
+                MediumBlock* block = reinterpret_cast<MediumBlock*>(reinterpret_cast<u64>(memory) - sizeof(MediumBlock));
+                if (MemoryPool::resizeMediumBlock(block, aligmentedSize))
                 {
-                    pool->reset();
-
-                    Pool* nextPool = pool->_next;
-                    m_poolTable._activePools.insert(pool);
-
-                    pool = nextPool;
+                    return memory;
                 }
             }
         }
-    }
-
-    void MemoryPool::clear()
-    {
-        //clear small table
-        for (auto& table : m_smallPoolTables)
+        else if (!pool && m_ownerThread == std::this_thread::get_id() && k_smallTableLayout != SmallTableLayout::AlignedSlab)
         {
-            assert(table._fullPools.empty());
-
-            auto pool = table._activePools.begin();
-            while (pool != table._activePools.end())
+            //large allocation, the allocator can grow it without copy
+            Block* block = reinterpret_cast<Block*>(reinterpret_cast<u64>(memory) - sizeof(Block));
+            if (Block* newBlock = MemoryPool::resizeLargeBlock(block, aligmentedSize); newBlock)
             {
-                assert(pool->_used.empty()); // used elements
-                Pool* freedPool = pool;
-                pool = pool->_next;
-
-                MemoryPool::deallocatePool(freedPool);
+                return newBlock->ptr();
             }
-            table._activePools.clear();
         }
 
-        //clear medium table
+        //move
+        u64 copySize = std::min<u64>(MemoryPool::getAllocationSize(memory), size);
+        address_ptr newMemory = MemoryPool::allocMemory(size);
+        memcpy(newMemory, memory, copySize);
+        MemoryPool::freeMemory(memory);
+
+        return newMemory;
+    }
+
+    bool MemoryPool::resizeMediumBlock(MediumBlock* block, u64 aligmentedSize)
+    {
+        Pool* pool = block->_pool;
+        assert(pool->_table->_type == PoolTable::Default);
+        assert(!block->isFree());
+
+        //a shrunk block must still hold the free block links once it is freed
+        u64 requestedSize = std::max<u64>(alignUp<u64>(aligmentedSize + sizeof(MediumBlock), DEFAULT_ALIGMENT), alignUp<u64>(sizeof(FreeMediumBlock) + sizeof(u64), DEFAULT_ALIGMENT));
+        u64 blockSize = block->size();
+        u64 poolEnd = reinterpret_cast<u64>(pool) + pool->_poolSize;
+
+        //grow into the next free block
+        u64 availableSize = blockSize;
+        MediumBlock* next = block->next();
+        bool nextFree = reinterpret_cast<u64>(next) < poolEnd && next->isFree();
+        if (nextFree)
         {
-            assert(m_poolTable._fullPools.empty());
+            availableSize += next->size();
+        }
 
-            auto pool = m_poolTable._activePools.begin();
-            while (pool != m_poolTable._activePools.end())
-            {
-                assert(pool->_used.empty()); // used elements
-                Pool* freedPool = pool;
-                pool = pool->_next;
+        if (availableSize < requestedSize)
+        {
+            return false;
+        }
 
-                MemoryPool::deallocatePool(freedPool);
-            }
-            m_poolTable._activePools.clear();
+        if (nextFree)
+        {
+            m_freeBlockIndex.erase(static_cast<FreeMediumBlock*>(next));
         }
 
-        //clear large allocations
-        assert(m_largeAllocations.empty()); //used elements
-        auto block = m_largeAllocations.begin();
-        while (block != m_largeAllocations.end())
+        u64 newSize = availableSize;
+        u64 freeMemory = availableSize - requestedSize;
+        if (freeMemory >= k_minSizeMediumSplit)
         {
-            u64 blockSize = block->_size;
-            m_allocator->deallocate(&block, blockSize, m_userData);
+            newSize = requestedSize;
+            MemoryPool::insertFreeMediumBlock(reinterpret_cast<address_ptr>(reinterpret_cast<u64>(block) + requestedSize), pool, freeMemory);
+        }
+        else if (MediumBlock* last = reinterpret_cast<MediumBlock*>(reinterpret_cast<u64>(block) + availableSize); reinterpret_cast<u64>(last) < poolEnd)
+        {
+            last->_size &= ~MediumBlock::k_prevFreeBit;
         }
-        m_largeAllocations.clear();
 
 #if ENABLE_STATISTIC
-        m_statistic.reset();
+        m_statistic.registerDeallocation<1>(blockSize);
+        m_statistic.registerAllocation<1>(newSize);
 #endif //ENABLE_STATISTIC
+
+        pool->_blockSize = pool->_blockSize - blockSize + newSize;
+        pool->_requestedSize = pool->_requestedSize - block->_requestedSize + aligmentedSize;
+        assert(pool->_blockSize <= pool->_poolSize);
+
+        block->_size = static_cast<u32>(newSize) | (block->_size & MediumBlock::k_prevFreeBit);
+        block->_requestedSize = static_cast<u32>(aligmentedSize);
+
+        return true;
     }
 
-    MemoryPool::MemoryAllocator* MemoryPool::getDefaultMemoryAllocator()
+    MemoryPool::Block* MemoryPool::resizeLargeBlock(Block* block, u64 aligmentedSize)
     {
-        if (!s_defaultMemoryAllocator)
+        assert(!block->_pool);
+        if (block->allocation() != block)
         {
-            s_defaultMemoryAllocator = new DefaultMemoryAllocator();
+            //aligned allocation, the allocator can't keep the gap
+            return nullptr;
         }
-        return s_defaultMemoryAllocator;
-    }
 
-    MemoryPool::Pool* MemoryPool::allocateFixedBlocksPool(PoolTable* table, u32 align)
-    {
-        u64 blockSize = table->_size + sizeof(Block);
-        u64 countAllocations = ((k_maxSizePoolAllocation * k_countPagesPerAllocation) - sizeof(Pool)) / blockSize;
-        u64 allocatedSize = alignUp<u64>(k_maxSizePoolAllocation, (countAllocations * blockSize) + sizeof(Pool));
+        u64 blockSize = block->_size;
+        u64 allocationSize = alignUp<u64>(aligmentedSize + sizeof(Block), DEFAULT_ALIGMENT);
+        if (allocationSize > blockSize)
+        {
+            //growing in place or by remap takes new memory as well
+            MemoryPool::checkMemoryBudget(allocationSize - blockSize);
+        }
 
-        address_ptr memory = m_allocator->allocate(allocatedSize, align, m_userData);
-        assert(memory);
+        //the list links live inside the block, unlink before the allocator moves it
+        m_largeAllocations.erase(block);
+        address_ptr memory = m_allocator->reallocate(block, blockSize, allocationSize, m_userData);
+        if (!memory)
+        {
+            m_largeAllocations.insert(block);
+            return nullptr;
+        }
 
-        Pool* pool = new(memory) Pool(table, table->_size, allocatedSize);
-        u64 memoryOffset = reinterpret_cast<u64>(pool->ptr());
+        Block* newBlock = initBlock(memory, nullptr, allocationSize);
+        m_largeAllocations.insert(newBlock);
+        m_largeSize = m_largeSize - blockSize + allocationSize;
+        if (m_region)
+        {
+            m_regionLargeAllocations.erase(block->ptr());
+            m_regionLargeAllocations.insert(newBlock->ptr());
+        }
 
 #if ENABLE_STATISTIC
-        m_statistic.registerPoolAllocation<0>(allocatedSize);
+        m_statistic.registerDeallocation<2>(blockSize);
+        m_statistic.registerPoolDeallocation<2>(blockSize);
+        m_statistic.registerAllocation<2>(allocationSize);
+        m_statistic.registerPoolAllocation<2>(allocationSize);
 #endif //ENABLE_STATISTIC
 
-        for (u32 i = 0; i < countAllocations; ++i)
+        return newBlock;
+    }
+
+    u64 MemoryPool::getAllocationSize(address_ptr memory) const
+    {
+        if (Pool* pool = MemoryPool::getPool(memory); pool)
         {
-            address_ptr memoryBlock = reinterpret_cast<address_ptr>(memoryOffset + (i * (table->_size + sizeof(Block))));
-            Block* block = initBlock(memoryBlock, pool, blockSize);
-            pool->_free.insert(block);
+            address_ptr blockMemory = MemoryPool::getBlockMemory(pool, memory);
+            u64 offset = reinterpret_cast<u64>(memory) - reinterpret_cast<u64>(blockMemory);
+            if (pool->_table->_type == PoolTable::Default)
+            {
+                MediumBlock* block = reinterpret_cast<MediumBlock*>(reinterpret_cast<u64>(blockMemory) - sizeof(MediumBlock));
+                return block->size() - sizeof(MediumBlock) - offset;
+            }
+
+            //size class of the table
+            return pool->_blockSize - offset;
         }
 
-        return pool;
+        Block* block = reinterpret_cast<Block*>(reinterpret_cast<u64>(memory) - sizeof(Block));
+        u64 start = (k_smallTableLayout == SmallTableLayout::AlignedSlab) ? (reinterpret_cast<u64>(block) & ~(k_poolSize - 1)) : reinterpret_cast<u64>(block->allocation());
+        return block->allocationSize() - (reinterpret_cast<u64>(memory) - start);
     }
 
-    MemoryPool::Pool* MemoryPool::allocatePool(PoolTable* table, u32 align)
+    void MemoryPool::freeMemoryLocal(address_ptr memory)
     {
-        u64 allocatedSize = alignUp<u64>(k_maxSizePoolAllocation * k_countPagesPerAllocation, align);
-        assert(table->_size == allocatedSize); //different aligment
-        address_ptr memory = m_allocator->allocate(allocatedSize, align, m_userData);
-        assert(memory);
-
-        Pool* pool = new(memory) Pool(table, 0, allocatedSize);
-
 #if ENABLE_STATISTIC
-        m_statistic.registerPoolAllocation<1>(allocatedSize);
+        auto startTime = std::chrono::high_resolution_clock::now();
 #endif //ENABLE_STATISTIC
+        if (Pool* pool = MemoryPool::getPool(memory); pool)
+        {
+            MemoryPool::freePoolMemory(pool, memory);
+        }
+        else
+        {
+            //with the region every pointer outside the live pools must be a large allocation
+            if (m_region && m_regionLargeAllocations.erase(memory) == 0)
+            {
+                assert(false && "memory is not allocated by the pool");
+                return;
+            }
+            MemoryPool::freeLargeBlock(reinterpret_cast<Block*>(reinterpret_cast<u64>(memory) - sizeof(Block)));
+        }
 
-        Block* block = initBlock(pool->ptr(), pool, allocatedSize - sizeof(Pool));
-        pool->_free.insert(block);
-
-        return pool;
+#if ENABLE_STATISTIC
+        auto endTime = std::chrono::high_resolution_clock::now();
+        m_statistic._dealocateTime += std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
+#endif //ENABLE_STATISTIC
     }
 
-    void MemoryPool::deallocatePool(Pool* pool)
+    void MemoryPool::preAllocatePools()
     {
-        assert(pool);
-        assert(pool->_used.empty());
-        m_allocator->deallocate(pool, pool->_poolSize, m_userData);
+        for (auto& table : m_smallPoolTables)
+        {
+            assert(table._activePools.empty());
+            Pool* pool = MemoryPool::allocateSmallPool(&table);
+            table._activePools.insert(pool);
+            ++table._countEmptyPools;
+        }
     }
 
-    MemoryPool::Block* MemoryPool::initBlock(address_ptr ptr, Pool* pool, u64 size)
+    MemoryPool* MemoryPool::createHeap()
     {
-        assert(size >= sizeof(Block));
-        Block* block = new(ptr)Block(pool, size);
-#if DEBUG_MEMORY
-        block->reset();
-        block->_ptr = (address_ptr)(reinterpret_cast<u64>(ptr) + sizeof(Block));
-#endif //DEBUG_MEMORY
+        //size classes are shared, the tables of the heap are empty until it allocates
+        MemoryPool* heap = new MemoryPool(k_pageSize, m_allocator, k_deleteUnusedPools, m_userData, k_smallTableLayout);
+        heap->m_parent = this;
+        m_countHeaps.fetch_add(1, std::memory_order_relaxed);
 
-        return block;
+        return heap;
     }
 
-    void MemoryPool::freeBlock(Block* block)
+    void MemoryPool::destroyHeap(MemoryPool* heap)
     {
-        Pool* pool = block->_pool;
-        pool->_used.erase(block);
+        assert(heap && heap->m_parent == this && "heap is not created by this pool");
+        heap->releaseHeapPools();
+        delete heap;
+        m_countHeaps.fetch_sub(1, std::memory_order_relaxed);
+    }
 
-        if (pool->_free.empty()) //full pools
+    void MemoryPool::releaseHeapPools()
+    {
+        //blocks are dropped with their pools, remote frees of them are ignored
+        for (PoolTable* table = m_smallPoolTables.data(); table != m_smallPoolTables.data() + m_smallPoolTables.size(); ++table)
         {
-            PoolTable* table = const_cast<PoolTable*>(pool->_table);
-            table->_fullPools.erase(pool);
-            table->_activePools.insert(pool);
+            MemoryPool::deallocatePools(table->_activePools);
+            MemoryPool::deallocatePools(table->_fullPools);
+            MemoryPool::deallocatePools(table->_stalePools);
+            table->_countEmptyPools = 0;
+            table->_remoteFreeCount.store(0, std::memory_order_relaxed);
         }
 
-        if (pool->_table->_type == PoolTable::SmallTable)
+        MemoryPool::deallocatePools(m_poolTable._activePools);
+        MemoryPool::deallocatePools(m_poolTable._stalePools);
+        m_poolTable._countEmptyPools = 0;
+        m_poolTable._remoteFreeCount.store(0, std::memory_order_relaxed);
+        m_freeBlockIndex.clear();
+
+        MemoryPool::drainRemoteLargeFree();
+        while (!m_largeAllocations.empty())
         {
-            assert(block->_size == pool->_table->_size + sizeof(Block));
-            pool->_free.insert(block);
+            MemoryPool::freeLargeBlock(m_largeAllocations.begin());
+        }
+        MemoryPool::purgeLargeCache();
+
 #if ENABLE_STATISTIC
-            m_statistic.registerDeallocation<0>(block->_size);
+        m_statistic.reset();
 #endif //ENABLE_STATISTIC
+    }
+
+    address_ptr MemoryPool::acquireHeapSpan(u32 align, address_ptr& span, u64& spanSize)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_heapMutex);
+            if (!m_heapSupply.empty())
+            {
+                HeapSpan heapSpan = m_heapSupply.back();
+                m_heapSupply.pop_back();
+                m_heapSupplySize.fetch_sub(k_poolSize, std::memory_order_relaxed);
+
+                span = heapSpan._span;
+                spanSize = heapSpan._spanSize;
+                return heapSpan._memory;
+            }
+        }
+
+        //the region of the parent is not shared, it's owned by the parent thread
+        return MemoryPool::allocateAllocatorSpan(align, span, spanSize);
+    }
+
+    void MemoryPool::releaseHeapSpan(address_ptr memory, address_ptr span, u64 spanSize)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_heapMutex);
+            if (m_heapSupply.size() * k_poolSize < k_heapSupplyLimit)
+            {
+                m_heapSupply.push_back({ memory, span, spanSize });
+                m_heapSupplySize.fetch_add(k_poolSize, std::memory_order_relaxed);
+                return;
+            }
+        }
+
+        if (span == memory)
+        {
+            MemoryPool::deallocateSpan(memory, spanSize);
+        }
+        else
+        {
+            m_allocator->deallocate(span, spanSize, m_userData);
+        }
+    }
+
+    bool MemoryPool::reserveRegion(u64 size)
+    {
+        assert(!m_region && "region is already reserved");
+        assert(m_poolTable._activePools.empty() && m_largeAllocations.empty() && "must be called before the first allocation");
+        if (m_region || (k_poolSize & (k_poolSize - 1)) != 0)
+        {
+            return false;
+        }
+
+        //aligned to the pool size, the address mask of the aligned slab layout keeps working
+        u64 regionSize = alignUp<u64>(size, k_poolSize);
+        address_ptr memory = MemoryPool::allocateAlignedSpan(regionSize, m_regionSpan, m_regionSpanSize);
+        if (!memory)
+        {
+            return false;
+        }
+
+        m_region = memory;
+        m_regionSize = regionSize;
+        m_regionShift = bitScanForward(k_poolSize);
+        m_regionCarvedSlots = 0;
+        m_regionPools.assign(static_cast<size_t>(regionSize >> m_regionShift), nullptr);
+        m_regionFreeSlots.clear();
+        m_regionRetainedSlots.clear();
+
+        return true;
+    }
+
+    bool MemoryPool::owns(address_ptr memory) const
+    {
+        assert(m_region && "region is not reserved");
+        u64 offset = reinterpret_cast<u64>(memory) - reinterpret_cast<u64>(m_region);
+        if (offset < m_regionSize)
+        {
+            return m_regionPools[offset >> m_regionShift] != nullptr;
+        }
+
+        return m_regionLargeAllocations.find(memory) != m_regionLargeAllocations.end();
+    }
+
+    void MemoryPool::reset()
+    {
+        //pools are reset lazily, when a table takes them again
+        //remote frees stay counted until the stale pools drop them
+        for (auto& table : m_smallPoolTables)
+        {
+            table._countEmptyPools = 0;
+            table._stalePools.splice(table._activePools);
+            table._stalePools.splice(table._fullPools);
+        }
+
+        //medium table
+        m_poolTable._countEmptyPools = 0;
+        m_poolTable._stalePools.splice(m_poolTable._activePools);
+        assert(m_poolTable._fullPools.empty());
+        m_freeBlockIndex.clear();
+    }
+
+    void MemoryPool::clear()
+    {
+        MemoryPool::drainRemoteLargeFree();
+
+        //clear small table
+        for (auto& table : m_smallPoolTables)
+        {
+            MemoryPool::deallocateStalePools(table);
+            MemoryPool::drainRemoteFree(table);
+            assert(table._fullPools.empty());
+
+            auto pool = table._activePools.begin();
+            while (pool != table._activePools.end())
+            {
+                assert(pool->isEmpty()); // used elements
+                Pool* freedPool = pool;
+                pool = pool->_next;
+
+                MemoryPool::deallocatePool(freedPool);
+            }
+            table._activePools.clear();
+            table._countEmptyPools = 0;
+        }
+
+        //clear medium table
+        {
+            MemoryPool::deallocateStalePools(m_poolTable);
+            MemoryPool::drainRemoteFree(m_poolTable);
+            assert(m_poolTable._fullPools.empty());
+
+            auto pool = m_poolTable._activePools.begin();
+            while (pool != m_poolTable._activePools.end())
+            {
+                assert(pool->isEmpty()); // used elements
+                Pool* freedPool = pool;
+                pool = pool->_next;
+
+                MemoryPool::deallocatePool(freedPool);
+            }
+            m_poolTable._activePools.clear();
+            m_poolTable._countEmptyPools = 0;
+            m_freeBlockIndex.clear();
+        }
+
+        //clear large allocations
+        MemoryPool::purgeLargeCache();
+        assert(m_largeAllocations.empty()); //used elements
+        auto block = m_largeAllocations.begin();
+        while (block != m_largeAllocations.end())
+        {
+            u64 blockSize = block->_size;
+            m_allocator->deallocate(&block, blockSize, m_userData);
+        }
+        m_largeAllocations.clear();
+        m_regionLargeAllocations.clear();
+
+#if ENABLE_STATISTIC
+        m_statistic.reset();
+#endif //ENABLE_STATISTIC
+    }
+
+    MemoryPool::MemoryAllocator::~MemoryAllocator()
+    {
+        PageCache::getInstance().forget(this);
+    }
+
+    MemoryPool::MemoryAllocator* MemoryPool::getDefaultMemoryAllocator()
+    {
+        if (!s_defaultMemoryAllocator)
+        {
+            s_defaultMemoryAllocator = new DefaultMemoryAllocator();
+        }
+        return s_defaultMemoryAllocator;
+    }
+
+    MemoryPool::Pool* MemoryPool::allocateSmallPool(PoolTable* table)
+    {
+        if (table->_type == PoolTable::SmallTable)
+        {
+            return MemoryPool::allocateFixedBlocksPool(table, DEFAULT_ALIGMENT);
+        }
+
+        return MemoryPool::allocateSlabPool(table, DEFAULT_ALIGMENT);
+    }
+
+    MemoryPool::Pool* MemoryPool::allocateFixedBlocksPool(PoolTable* table, u32 align)
+    {
+        u64 blockSize = table->_size + sizeof(Block);
+        u64 countAllocations = (k_poolSize - sizeof(Pool)) / blockSize;
+        u64 allocatedSize = k_poolSize;
+
+        address_ptr span = nullptr;
+        u64 spanSize = 0;
+        address_ptr memory = MemoryPool::allocatePoolSpan(align, span, spanSize);
+        assert(memory);
+
+        Pool* pool = new(memory) Pool(table, table->_size, allocatedSize);
+        pool->_span = span;
+        pool->_spanSize = spanSize;
+        pool->_countBlocks = static_cast<u32>(countAllocations); //blocks are carved on demand
+
+#if ENABLE_STATISTIC
+        m_statistic.registerPoolAllocation<0>(allocatedSize);
+#endif //ENABLE_STATISTIC
+
+        return pool;
+    }
+
+    MemoryPool::Pool* MemoryPool::allocateSlabPool(PoolTable* table, u32 align)
+    {
+        //[Pool][bitmap][header|block][header|block]..., the owner is the last word of the header, aligned pools don't keep the owner
+        u64 slotAligment = DEFAULT_ALIGMENT;
+        u64 headerSize = 0;
+        if (table->_type == PoolTable::CacheLineTable)
+        {
+            slotAligment = k_cacheLineSize;
+            headerSize = (k_smallTableLayout == SmallTableLayout::AlignedSlab) ? 0 : k_cacheLineSize;
+        }
+        else if (table->_type == PoolTable::SlabTable)
+        {
+            headerSize = alignUp<u64>(sizeof(Pool*), DEFAULT_ALIGMENT);
+        }
+
+        u64 slotSize = table->_size + headerSize;
+        u64 availableSize = k_poolSize - sizeof(Pool) - (slotAligment - DEFAULT_ALIGMENT);
+        u64 countAllocations = (availableSize * 8) / (slotSize * 8 + 1);
+        while (((countAllocations + 63) >> 6) * sizeof(u64) + countAllocations * slotSize > availableSize)
+        {
+            --countAllocations;
+        }
+        assert(countAllocations > 0 && countAllocations <= std::numeric_limits<u32>::max());
+        u64 allocatedSize = k_poolSize;
+
+        address_ptr span = nullptr;
+        u64 spanSize = 0;
+        address_ptr memory = MemoryPool::allocatePoolSpan(align, span, spanSize);
+        assert(memory);
+
+        Pool* pool = new(memory) Pool(table, table->_size, allocatedSize);
+        pool->_span = span;
+        pool->_spanSize = spanSize;
+        pool->_bitmap = reinterpret_cast<u64*>(pool->ptr());
+        pool->_countBlocks = static_cast<u32>(countAllocations);
+        pool->_slotSize = static_cast<u32>(slotSize);
+        pool->_slabs = alignUp<u64>(reinterpret_cast<u64>(pool->_bitmap) + ((countAllocations + 63) >> 6) * sizeof(u64), slotAligment);
+        pool->resetBitmap();
+
+#if ENABLE_STATISTIC
+        m_statistic.registerPoolAllocation<0>(allocatedSize);
+#endif //ENABLE_STATISTIC
+
+        return pool;
+    }
+
+    MemoryPool::Pool* MemoryPool::allocatePool(PoolTable* table, u32 align)
+    {
+        u64 allocatedSize = k_poolSize;
+        assert(table->_size == allocatedSize); //different aligment
+        address_ptr span = nullptr;
+        u64 spanSize = 0;
+        address_ptr memory = MemoryPool::allocatePoolSpan(align, span, spanSize);
+        assert(memory);
+
+        Pool* pool = new(memory) Pool(table, 0, allocatedSize);
+        pool->_span = span;
+        pool->_spanSize = spanSize;
+
+#if ENABLE_STATISTIC
+        m_statistic.registerPoolAllocation<1>(allocatedSize);
+#endif //ENABLE_STATISTIC
+
+        static_assert(sizeof(Pool) % DEFAULT_ALIGMENT == 0, "medium blocks must stay aligned");
+        MemoryPool::insertFreeMediumBlock(pool->ptr(), pool, allocatedSize - sizeof(Pool));
+
+        return pool;
+    }
+
+    void MemoryPool::deallocatePool(Pool* pool, bool toCache)
+    {
+        assert(pool);
+        assert(pool->isEmpty());
+        m_poolsSize -= pool->_poolSize;
+        if (m_region)
+        {
+            MemoryPool::deallocateRegionSpan(pool);
+        }
+        else if (m_parent && toCache)
+        {
+            m_parent->releaseHeapSpan(pool, pool->_span, pool->_spanSize);
+        }
+        else if (pool->_span == pool && toCache)
+        {
+            MemoryPool::deallocateSpan(pool, pool->_spanSize);
+        }
+        else
+        {
+            //over allocated span, the page cache keeps only aligned spans
+            m_allocator->deallocate(pool->_span, pool->_spanSize, m_userData);
+        }
+    }
+
+    MemoryPool::Pool* MemoryPool::takeStalePool(PoolTable& table)
+    {
+        if (table._stalePools.empty())
+        {
+            return nullptr;
+        }
+
+        //blocks of the pool died with the reset, remote frees of them are dropped
+        Pool* pool = table._stalePools.begin();
+        table._stalePools.erase(pool);
+        MemoryPool::dropRemoteFree(table, pool);
+        pool->reset();
+        if (table._type == PoolTable::Default)
+        {
+            pool->_blockSize = 0;
+            pool->_requestedSize = 0;
+            MemoryPool::insertFreeMediumBlock(pool->ptr(), pool, pool->_poolSize - sizeof(Pool));
+        }
+
+        return pool;
+    }
+
+    void MemoryPool::dropRemoteFree(PoolTable& table, Pool* pool)
+    {
+        u64 count = 0;
+        address_ptr memory = pool->_remoteFree.exchange(nullptr, std::memory_order_acquire);
+        while (memory)
+        {
+            memory = *reinterpret_cast<address_ptr*>(memory);
+            ++count;
+        }
+        table._remoteFreeCount.fetch_sub(count, std::memory_order_relaxed);
+    }
+
+    void MemoryPool::deallocateStalePools(PoolTable& table)
+    {
+        for (Pool* pool = table._stalePools.begin(); pool != table._stalePools.end(); pool = pool->_next)
+        {
+            MemoryPool::dropRemoteFree(table, pool);
+        }
+        MemoryPool::deallocatePools(table._stalePools);
+    }
+
+    void MemoryPool::deallocatePools(List<Pool>& pools)
+    {
+        //live blocks are dropped with the pools
+        auto pool = pools.begin();
+        while (pool != pools.end())
+        {
+            Pool* freedPool = pool;
+            pool = pool->_next;
+
+            freedPool->_countUsed = 0;
+            MemoryPool::deallocatePool(freedPool);
+        }
+        pools.clear();
+    }
+
+    address_ptr MemoryPool::allocatePoolSpan(u32 align, address_ptr& span, u64& spanSize)
+    {
+        MemoryPool::checkMemoryBudget(k_poolSize);
+        m_poolsSize += k_poolSize;
+        if (m_region)
+        {
+            span = MemoryPool::allocateRegionSpan();
+            spanSize = k_poolSize;
+            return span;
+        }
+
+        if (m_parent)
+        {
+            return m_parent->acquireHeapSpan(align, span, spanSize);
+        }
+
+        return MemoryPool::allocateAllocatorSpan(align, span, spanSize);
+    }
+
+    address_ptr MemoryPool::allocateAllocatorSpan(u32 align, address_ptr& span, u64& spanSize)
+    {
+        if (k_smallTableLayout != SmallTableLayout::AlignedSlab)
+        {
+            span = MemoryPool::allocateSpan(k_poolSize, align);
+            spanSize = k_poolSize;
+            return span;
+        }
+
+        span = PageCache::getInstance().acquireSpan(m_allocator, k_poolSize, m_userData, static_cast<u32>(k_poolSize));
+        if (span)
+        {
+            spanSize = k_poolSize;
+            return span;
+        }
+
+        return MemoryPool::allocateAlignedSpan(k_poolSize, span, spanSize);
+    }
+
+    address_ptr MemoryPool::allocateAlignedSpan(u64 size, address_ptr& span, u64& spanSize)
+    {
+        span = m_allocator->allocate(size, static_cast<u32>(k_poolSize), m_userData);
+        spanSize = size;
+        assert(span);
+        if ((reinterpret_cast<u64>(span) & (k_poolSize - 1)) == 0)
+        {
+            return span;
+        }
+
+        //allocator ignores the aligment, over allocate and align inside the span
+        m_allocator->deallocate(span, spanSize, m_userData);
+        spanSize = size + k_poolSize;
+        span = m_allocator->allocate(spanSize, static_cast<u32>(k_poolSize), m_userData);
+        assert(span);
+
+        return reinterpret_cast<address_ptr>(alignUp<u64>(reinterpret_cast<u64>(span), k_poolSize));
+    }
+
+    address_ptr MemoryPool::allocateSpan(u64 size, u32 align)
+    {
+        address_ptr memory = PageCache::getInstance().acquireSpan(m_allocator, size, m_userData);
+        if (!memory)
+        {
+            memory = m_allocator->allocate(size, align, m_userData);
+        }
+
+        return memory;
+    }
+
+    void MemoryPool::deallocateSpan(address_ptr memory, u64 size)
+    {
+        if (!PageCache::getInstance().releaseSpan(m_allocator, memory, size, m_userData))
+        {
+            m_allocator->deallocate(memory, size, m_userData);
+        }
+    }
+
+    address_ptr MemoryPool::allocateRegionSpan()
+    {
+        //committed slots first, their pages don't fault again
+        u32 slot = 0;
+        if (!m_regionRetainedSlots.empty())
+        {
+            slot = m_regionRetainedSlots.back();
+            m_regionRetainedSlots.pop_back();
+        }
+        else if (!m_regionFreeSlots.empty())
+        {
+            slot = m_regionFreeSlots.back();
+            m_regionFreeSlots.pop_back();
+        }
+        else
+        {
+            assert(m_regionCarvedSlots < m_regionPools.size() && "region is exhausted");
+            if (m_regionCarvedSlots == m_regionPools.size())
+            {
+                return nullptr;
+            }
+            slot = m_regionCarvedSlots++;
+        }
+
+        //the pool header is placed at the start of the span
+        address_ptr span = reinterpret_cast<address_ptr>(reinterpret_cast<u64>(m_region) + (static_cast<u64>(slot) << m_regionShift));
+        m_regionPools[slot] = reinterpret_cast<Pool*>(span);
+        return span;
+    }
+
+    void MemoryPool::deallocateRegionSpan(Pool* pool)
+    {
+        u64 slot = (reinterpret_cast<u64>(pool) - reinterpret_cast<u64>(m_region)) >> m_regionShift;
+        assert(m_regionPools[slot] == pool);
+        m_regionPools[slot] = nullptr;
+
+        //the region is allocated once, the pages of the slot are returned by the allocator
+        if (m_allocator->purge(pool, pool->_poolSize, m_userData))
+        {
+            m_regionFreeSlots.push_back(static_cast<u32>(slot));
+        }
+        else
+        {
+            m_regionRetainedSlots.push_back(static_cast<u32>(slot));
+        }
+    }
+
+    MemoryPool::Block* MemoryPool::initBlock(address_ptr ptr, Pool* pool, u64 size)
+    {
+        assert(size >= sizeof(Block));
+        Block* block = new(ptr)Block(pool, size);
+#if DEBUG_MEMORY
+        block->reset();
+        block->_ptr = (address_ptr)(reinterpret_cast<u64>(ptr) + sizeof(Block));
+#endif //DEBUG_MEMORY
+
+        return block;
+    }
+
+    void MemoryPool::freeBlock(Block* block)
+    {
+        Pool* pool = block->_pool;
+        pool->_used.erase(block);
+        assert(pool->_countUsed > 0);
+        --pool->_countUsed;
+
+        if (pool->isFull()) //full pools
+        {
+            PoolTable* table = const_cast<PoolTable*>(pool->_table);
+            table->_fullPools.erase(pool);
+            table->_activePools.insert(pool);
+        }
+
+        assert(pool->_table->_type == PoolTable::SmallTable);
+        assert(block->_size == pool->_table->_size + sizeof(Block));
+        pool->_free.insert(block);
+#if ENABLE_STATISTIC
+        m_statistic.registerDeallocation<0>(block->_size);
+#endif //ENABLE_STATISTIC
+
+        if (pool->isEmpty())
+        {
+            MemoryPool::onPoolEmpty(*const_cast<PoolTable*>(pool->_table), pool);
+        }
+    }
+
+    void MemoryPool::freeMediumBlock(MediumBlock* block)
+    {
+        Pool* pool = block->_pool;
+        assert(pool->_table->_type == PoolTable::Default);
+        assert(!block->isFree() && "double free");
+        assert(pool->_countUsed > 0);
+        --pool->_countUsed;
+
+        u64 blockSize = block->size();
+        assert(pool->_blockSize >= blockSize);
+        pool->_blockSize -= blockSize;
+        assert(pool->_requestedSize >= block->_requestedSize);
+        pool->_requestedSize -= block->_requestedSize;
+
+#if ENABLE_STATISTIC
+        m_statistic.registerDeallocation<1>(blockSize);
+#endif //ENABLE_STATISTIC
+
+        //merge with the physical neighbours
+        u64 poolEnd = reinterpret_cast<u64>(pool) + pool->_poolSize;
+        if (MediumBlock* next = block->next(); reinterpret_cast<u64>(next) < poolEnd && next->isFree())
+        {
+            blockSize += next->size();
+            m_freeBlockIndex.erase(static_cast<FreeMediumBlock*>(next));
+        }
+
+        if (block->isPrevFree())
+        {
+            MediumBlock* prev = block->prev();
+            assert(prev->isFree());
+            blockSize += prev->size();
+            m_freeBlockIndex.erase(static_cast<FreeMediumBlock*>(prev));
+            block = prev;
+        }
+        MemoryPool::insertFreeMediumBlock(block, pool, blockSize);
+
+        if (pool->isEmpty())
+        {
+            MemoryPool::onPoolEmpty(m_poolTable, pool);
+        }
+    }
+
+    void MemoryPool::insertFreeMediumBlock(address_ptr memory, Pool* pool, u64 size)
+    {
+        //previous block is always used, free neighbours are merged
+        assert(size >= sizeof(FreeMediumBlock) + sizeof(u64));
+        FreeMediumBlock* block = static_cast<FreeMediumBlock*>(new(memory) MediumBlock(pool, size | MediumBlock::k_freeBit));
+        *reinterpret_cast<u64*>(reinterpret_cast<u64>(block) + size - sizeof(u64)) = size;
+
+        u64 poolEnd = reinterpret_cast<u64>(pool) + pool->_poolSize;
+        if (MediumBlock* next = block->next(); reinterpret_cast<u64>(next) < poolEnd)
+        {
+            next->_size |= MediumBlock::k_prevFreeBit;
+        }
+
+        m_freeBlockIndex.insert(block);
+    }
+
+    void MemoryPool::freeSlabBlock(Pool* pool, address_ptr memory)
+    {
+        u64 slotSize = pool->slotSize();
+        u64 headerSize = slotSize - pool->_blockSize;
+        u64 index = (reinterpret_cast<u64>(memory) - headerSize - pool->_slabs) / slotSize;
+        assert(index < pool->_countBlocks && "block is not from this pool");
+        assert(pool->_slabs + index * slotSize + headerSize == reinterpret_cast<u64>(memory) && "invalid block address");
+
+        u32 wordIndex = static_cast<u32>(index >> 6);
+        u64 mask = 1ULL << (index & 63);
+        assert(!(pool->_bitmap[wordIndex] & mask) && "double free");
+
+        if (pool->isFull()) //full pools
+        {
+            PoolTable* table = const_cast<PoolTable*>(pool->_table);
+            table->_fullPools.erase(pool);
+            table->_activePools.insert(pool);
+        }
+
+        pool->_bitmap[wordIndex] |= mask;
+        --pool->_countUsed;
+        pool->_searchIndex = std::min(pool->_searchIndex, wordIndex);
+
+#if ENABLE_STATISTIC
+        m_statistic.registerDeallocation<0>(slotSize);
+#endif //ENABLE_STATISTIC
+
+        if (pool->isEmpty())
+        {
+            MemoryPool::onPoolEmpty(*const_cast<PoolTable*>(pool->_table), pool);
+        }
+    }
+
+    void MemoryPool::freePoolMemory(Pool* pool, address_ptr memory)
+    {
+        memory = MemoryPool::getBlockMemory(pool, memory);
+        if (pool->isSlab())
+        {
+            MemoryPool::freeSlabBlock(pool, memory);
+        }
+        else if (pool->_table->_type == PoolTable::Default)
+        {
+            MemoryPool::freeMediumBlock(reinterpret_cast<MediumBlock*>(reinterpret_cast<u64>(memory) - sizeof(MediumBlock)));
+        }
+        else
+        {
+            MemoryPool::freeBlock(reinterpret_cast<Block*>(reinterpret_cast<u64>(memory) - sizeof(Block)));
+        }
+    }
+
+    void MemoryPool::onPoolEmpty(PoolTable& table, Pool* pool)
+    {
+        //keep a few empty pools, a table on the edge of a pool doesn't allocate/release it on each call
+        if (!k_deleteUnusedPools || table._countEmptyPools < k_countEmptyPoolsPerTable)
+        {
+            ++table._countEmptyPools;
+            return;
+        }
+
+        table._activePools.erase(pool);
+        if (table._type == PoolTable::Default)
+        {
+            //empty medium pool is a single free block
+            m_freeBlockIndex.erase(reinterpret_cast<FreeMediumBlock*>(pool->ptr()));
+        }
+        MemoryPool::releasePool(table, pool, true);
+    }
+
+    void MemoryPool::releasePool(PoolTable& table, Pool* pool, bool toCache)
+    {
+#if ENABLE_STATISTIC
+        if (table._type == PoolTable::Default)
+        {
+            m_statistic.registerPoolDeallocation<1>(pool->_poolSize);
+        }
+        else
+        {
+            m_statistic.registerPoolDeallocation<0>(pool->_poolSize);
+        }
+#endif //ENABLE_STATISTIC
+        MemoryPool::deallocatePool(pool, toCache);
+    }
+
+    u64 MemoryPool::getFootprint() const
+    {
+        u64 regionRetainedSize = static_cast<u64>(m_regionRetainedSlots.size()) << m_regionShift;
+        return m_poolsSize + regionRetainedSize + m_largeSize + m_largeCachedSize + m_heapSupplySize.load(std::memory_order_relaxed);
+    }
+
+    u64 MemoryPool::trim(u64 targetSize)
+    {
+        u64 footprint = MemoryPool::getFootprint();
+        if (footprint <= targetSize)
+        {
+            return 0;
+        }
+
+        //cached large allocations, the oldest first
+        u64 excessSize = footprint - targetSize;
+        MemoryPool::evictLargeCache(m_largeCachedSize - std::min<u64>(m_largeCachedSize, excessSize));
+
+        //pools left by reset, then empty pools. Medium table is the last, its pools are the biggest allocations
+        std::vector<PoolTable*> tables;
+        tables.reserve(m_smallPoolTables.size() + 1);
+        for (PoolTable& table : m_smallPoolTables)
+        {
+            tables.push_back(&table);
+        }
+        tables.push_back(&m_poolTable);
+
+        for (PoolTable* table : tables)
+        {
+            while (!table->_stalePools.empty() && MemoryPool::getFootprint() > targetSize)
+            {
+                Pool* pool = table->_stalePools.begin();
+                table->_stalePools.erase(pool);
+                MemoryPool::dropRemoteFree(*table, pool);
+                pool->_countUsed = 0;
+                MemoryPool::releasePool(*table, pool, false);
+            }
+        }
+
+        for (PoolTable* table : tables)
+        {
+            Pool* pool = table->_activePools.begin();
+            while (table->_countEmptyPools > 0 && pool != table->_activePools.end() && MemoryPool::getFootprint() > targetSize)
+            {
+                Pool* nextPool = pool->_next;
+                if (pool->isEmpty() && pool->_remoteFree.load(std::memory_order_relaxed) == nullptr)
+                {
+                    table->_activePools.erase(pool);
+                    --table->_countEmptyPools;
+                    if (table->_type == PoolTable::Default)
+                    {
+                        m_freeBlockIndex.erase(reinterpret_cast<FreeMediumBlock*>(pool->ptr()));
+                    }
+                    MemoryPool::releasePool(*table, pool, false);
+                }
+                pool = nextPool;
+            }
+        }
+
+        //spans kept for the heaps
+        while (MemoryPool::getFootprint() > targetSize)
+        {
+            HeapSpan heapSpan;
+            {
+                std::lock_guard<std::mutex> lock(m_heapMutex);
+                if (m_heapSupply.empty())
+                {
+                    break;
+                }
+                heapSpan = m_heapSupply.back();
+                m_heapSupply.pop_back();
+                m_heapSupplySize.fetch_sub(k_poolSize, std::memory_order_relaxed);
+            }
+            m_allocator->deallocate(heapSpan._span, heapSpan._spanSize, m_userData);
+        }
+
+        return footprint - MemoryPool::getFootprint();
+    }
+
+    void MemoryPool::setMemoryBudget(u64 budget, BudgetCallback callback, void* user)
+    {
+        m_memoryBudget = budget;
+        m_budgetCallback = callback;
+        m_budgetUser = user;
+        m_overBudget = false;
+    }
+
+    u64 MemoryPool::getMemoryBudget() const
+    {
+        return m_memoryBudget;
+    }
+
+    void MemoryPool::checkMemoryBudget(u64 size)
+    {
+        //called before the pool takes new memory, size is the requested amount
+        if (m_memoryBudget == 0)
+        {
+            return;
+        }
+
+        if (MemoryPool::getFootprint() + size <= m_memoryBudget)
+        {
+            m_overBudget = false;
+            return;
+        }
+
+        MemoryPool::trim((m_memoryBudget > size) ? m_memoryBudget - size : 0);
+        u64 footprint = MemoryPool::getFootprint() + size;
+        if (footprint > m_memoryBudget && !m_overBudget)
+        {
+            m_overBudget = true;
+            if (m_budgetCallback)
+            {
+                m_budgetCallback(this, footprint, m_memoryBudget, m_budgetUser);
+            }
+        }
+    }
+
+    void MemoryPool::freeLargeBlock(Block* block)
+    {
+        assert(!block->_pool);
+        assert(!m_largeAllocations.empty() && "empty");
+        m_largeAllocations.erase(block);
+
+        u64 blockSize = block->allocationSize();
+        m_largeSize -= blockSize;
+#if ENABLE_STATISTIC
+        m_statistic.registerDeallocation<2>(blockSize);
+#endif //ENABLE_STATISTIC
+        if (k_smallTableLayout == SmallTableLayout::AlignedSlab)
+        {
+            Pool* header = reinterpret_cast<Pool*>(reinterpret_cast<u64>(block) & ~(k_poolSize - 1));
+            assert(!header->_table);
+            if (MemoryPool::releaseLargeCache(header, header->_poolSize, header->_span, header->_spanSize))
+            {
+                return;
+            }
+            m_allocator->deallocate(header->_span, header->_spanSize, m_userData);
+        }
+        else
+        {
+            if (block->allocation() == block && MemoryPool::releaseLargeCache(block, blockSize, block, blockSize))
+            {
+                return;
+            }
+            m_allocator->deallocate(block->allocation(), blockSize, m_userData);
+        }
+#if ENABLE_STATISTIC
+        m_statistic.registerPoolDeallocation<2>(blockSize);
+#endif //ENABLE_STATISTIC
+    }
+
+    address_ptr MemoryPool::acquireLargeCache(u64& size, address_ptr& span, u64& spanSize)
+    {
+        if (m_largeCachedSize == 0)
+        {
+            ++m_largeCacheStatistic._misses;
+            return nullptr;
+        }
+        MemoryPool::decayLargeCache(getTimeMilliseconds());
+
+        //a cached allocation up to twice bigger, the newest one first, its pages are likely still resident
+        u32 bucket = bitScanReverse(size);
+        for (u32 index = bucket; index < std::min(bucket + 2, k_countLargeCacheBuckets); ++index)
+        {
+            List<LargeCacheEntry>& entries = m_largeCache[index];
+            for (LargeCacheEntry* entry = entries.end()->_prev; entry != entries.end(); entry = entry->_prev)
+            {
+                if (entry->_size >= size && entry->_size <= size * 2)
+                {
+                    entries.erase(entry);
+                    m_largeCachedSize -= entry->_size;
+                    ++m_largeCacheStatistic._hits;
+
+                    size = entry->_size;
+                    span = entry->_span;
+                    spanSize = entry->_spanSize;
+                    return entry;
+                }
+            }
+        }
+
+        ++m_largeCacheStatistic._misses;
+        return nullptr;
+    }
+
+    bool MemoryPool::releaseLargeCache(address_ptr memory, u64 size, address_ptr span, u64 spanSize)
+    {
+        if (size > m_largeCacheLimit)
+        {
+            return false;
+        }
+
+        u64 time = getTimeMilliseconds();
+        MemoryPool::decayLargeCache(time);
+
+        MemoryPool::evictLargeCache(m_largeCacheLimit - size);
+
+        LargeCacheEntry* entry = new(memory) LargeCacheEntry();
+        entry->_size = size;
+        entry->_span = span;
+        entry->_spanSize = spanSize;
+        entry->_releaseTime = time;
+        m_largeCache[bitScanReverse(size)].insert(entry);
+        m_largeCachedSize += size;
+
+        return true;
+    }
+
+    void MemoryPool::evictLargeCache(u64 limit)
+    {
+        //the oldest entries first
+        while (m_largeCachedSize > limit)
+        {
+            LargeCacheEntry* oldest = nullptr;
+            for (auto& entries : m_largeCache)
+            {
+                if (!entries.empty() && (!oldest || entries.begin()->_releaseTime < oldest->_releaseTime))
+                {
+                    oldest = entries.begin();
+                }
+            }
+            assert(oldest);
+            MemoryPool::releaseLargeCacheEntry(oldest);
+        }
+    }
+
+    void MemoryPool::decayLargeCache(u64 time)
+    {
+        if (time < m_largeCacheNextDecay)
+        {
+            return;
+        }
+        m_largeCacheNextDecay = time + std::max<u64>(m_largeCacheDecay / 4, 1);
+
+        for (auto& entries : m_largeCache)
+        {
+            while (!entries.empty() && entries.begin()->_releaseTime + m_largeCacheDecay <= time)
+            {
+                MemoryPool::releaseLargeCacheEntry(entries.begin());
+            }
+        }
+    }
+
+    void MemoryPool::releaseLargeCacheEntry(LargeCacheEntry* entry)
+    {
+        m_largeCache[bitScanReverse(entry->_size)].erase(entry);
+        m_largeCachedSize -= entry->_size;
+        ++m_largeCacheStatistic._releases;
+#if ENABLE_STATISTIC
+        m_statistic.registerPoolDeallocation<2>(entry->_size);
+#endif //ENABLE_STATISTIC
+
+        m_allocator->deallocate(entry->_span, entry->_spanSize, m_userData);
+    }
+
+    void MemoryPool::setLargeCacheLimit(u64 size)
+    {
+        m_largeCacheLimit = size;
+        MemoryPool::evictLargeCache(m_largeCacheLimit);
+    }
+
+    u64 MemoryPool::getLargeCacheLimit() const
+    {
+        return m_largeCacheLimit;
+    }
+
+    void MemoryPool::setLargeCacheDecay(u64 milliseconds)
+    {
+        m_largeCacheDecay = milliseconds;
+        m_largeCacheNextDecay = 0;
+    }
+
+    u64 MemoryPool::getLargeCacheDecay() const
+    {
+        return m_largeCacheDecay;
+    }
+
+    void MemoryPool::purgeLargeCache()
+    {
+        for (auto& entries : m_largeCache)
+        {
+            while (!entries.empty())
+            {
+                MemoryPool::releaseLargeCacheEntry(entries.begin());
+            }
+        }
+        assert(m_largeCachedSize == 0);
+    }
+
+    MemoryPool::LargeCacheStatistic MemoryPool::getLargeCacheStatistic() const
+    {
+        LargeCacheStatistic statistic = m_largeCacheStatistic;
+        statistic._cachedSize = m_largeCachedSize;
+        return statistic;
+    }
+
+    MemoryPool::Pool* MemoryPool::getPool(address_ptr memory) const
+    {
+        if (m_region)
+        {
+            //memory outside the region and in a free slot is not pool memory
+            u64 offset = reinterpret_cast<u64>(memory) - reinterpret_cast<u64>(m_region);
+            return (offset < m_regionSize) ? m_regionPools[offset >> m_regionShift] : nullptr;
+        }
+
+        if (k_smallTableLayout == SmallTableLayout::AlignedSlab)
+        {
+            //every span is aligned to the pool size, large allocations keep a pool header without table
+            Pool* pool = reinterpret_cast<Pool*>(reinterpret_cast<u64>(memory) & ~(k_poolSize - 1));
+            return pool->_table ? pool : nullptr;
+        }
+
+        //block header and slab slot both end with the owner pool, nullptr for large allocations
+        return *reinterpret_cast<Pool**>(reinterpret_cast<u64>(memory) - sizeof(Pool*));
+    }
+
+    u64 MemoryPool::getAlignedAllocationSize(u64 size, u32 aligment) const
+    {
+        //the worst offset from a default aligned block keeps room for the header
+        return alignUp<u64>(size, DEFAULT_ALIGMENT) + aligment - DEFAULT_ALIGMENT + k_alignedHeaderSize;
+    }
+
+    address_ptr MemoryPool::alignBlockMemory(address_ptr memory, u32 aligment) const
+    {
+        u64 address = reinterpret_cast<u64>(memory);
+        if ((address & (aligment - 1)) == 0)
+        {
+            return memory;
+        }
+
+        //marker has the low bit set, block and medium block headers keep an even size there
+        u64 alignedAddress = alignUp<u64>(address + k_alignedHeaderSize, aligment);
+        *reinterpret_cast<u64*>(alignedAddress - k_alignedHeaderSize) = ((alignedAddress - address) << 1) | 1;
+        *reinterpret_cast<Pool**>(alignedAddress - sizeof(Pool*)) = MemoryPool::getPool(memory);
+
+        return reinterpret_cast<address_ptr>(alignedAddress);
+    }
+
+    address_ptr MemoryPool::getBlockMemory(Pool* pool, address_ptr memory) const
+    {
+        if (pool->isSlab())
+        {
+            //slot is found by the index, the memory before a slot belongs to the previous one
+            u64 slotSize = pool->slotSize();
+            u64 index = (reinterpret_cast<u64>(memory) - pool->_slabs) / slotSize;
+            return reinterpret_cast<address_ptr>(pool->_slabs + index * slotSize + (slotSize - pool->_blockSize));
+        }
+
+        u64 marker = *reinterpret_cast<u64*>(reinterpret_cast<u64>(memory) - k_alignedHeaderSize);
+        return (marker & 1) ? reinterpret_cast<address_ptr>(reinterpret_cast<u64>(memory) - (marker >> 1)) : memory;
+    }
+
+    MemoryPool* MemoryPool::getMemoryPool(address_ptr memory) const
+    {
+        if (Pool* pool = MemoryPool::getPool(memory); pool)
+        {
+            return pool->_table->_memoryPool;
+        }
+
+        //large allocations don't keep the owner
+        return nullptr;
+    }
+
+    bool MemoryPool::isLargeAllocation(u64 size, u32 aligment) const
+    {
+        if (aligment <= DEFAULT_ALIGMENT) //default
+        {
+            aligment = DEFAULT_ALIGMENT;
+        }
+
+        if (MemoryPool::getSmallTableIndex(size, aligment) != k_invalidTableIndex)
+        {
+            return false;
+        }
+
+        if (aligment != DEFAULT_ALIGMENT)
+        {
+            return MemoryPool::getAlignedAllocationSize(size, aligment) > k_maxSizePoolAllocation;
+        }
+
+        u64 aligmentedSize = alignUp<u64>(size, aligment);
+        return aligmentedSize > k_maxSizePoolAllocation;
+    }
+
+    void MemoryPool::pushRemoteFree(std::atomic<address_ptr>& list, address_ptr memory)
+    {
+        //lock free push (multi producers), remote blocks are linked through the first bytes of the user memory
+        address_ptr head = list.load(std::memory_order_relaxed);
+        do
+        {
+            *reinterpret_cast<address_ptr*>(memory) = head;
+        } while (!list.compare_exchange_weak(head, memory, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    void MemoryPool::drainRemoteFree(PoolTable& table)
+    {
+        //blocks of the stale pools died with the reset
+        for (Pool* pool = table._stalePools.begin(); pool != table._stalePools.end(); pool = pool->_next)
+        {
+            MemoryPool::dropRemoteFree(table, pool);
+        }
+
+        //take all lists first, freeBlock can move or delete pools
+        address_ptr blocks = nullptr;
+        for (List<Pool>* pools : { &table._activePools, &table._fullPools })
+        {
+            for (Pool* pool = pools->begin(); pool != pools->end(); pool = pool->_next)
+            {
+                address_ptr memory = pool->_remoteFree.exchange(nullptr, std::memory_order_acquire);
+                while (memory)
+                {
+                    address_ptr next = *reinterpret_cast<address_ptr*>(memory);
+                    *reinterpret_cast<address_ptr*>(memory) = blocks;
+                    blocks = memory;
+                    memory = next;
+                }
+            }
+        }
+
+        u64 count = 0;
+        while (blocks)
+        {
+            address_ptr next = *reinterpret_cast<address_ptr*>(blocks);
+            MemoryPool::freePoolMemory(MemoryPool::getPool(blocks), blocks);
+            blocks = next;
+            ++count;
+        }
+        table._remoteFreeCount.fetch_sub(count, std::memory_order_relaxed);
+    }
+
+    void MemoryPool::drainRemoteLargeFree()
+    {
+        address_ptr memory = m_remoteLargeFree.exchange(nullptr, std::memory_order_acquire);
+        while (memory)
+        {
+            address_ptr next = *reinterpret_cast<address_ptr*>(memory);
+            MemoryPool::freeLargeBlock(reinterpret_cast<Block*>(reinterpret_cast<u64>(memory) - sizeof(Block)));
+            memory = next;
+        }
+    }
+
+    u32 MemoryPool::getSmallTableIndex(u64 size, u32 aligment) const
+    {
+        if (aligment == k_cacheLineSize)
+        {
+            return (size <= k_maxSizeCacheLineAllocation) ? m_sizeClassIndex._cacheLineTableIndex[(alignUp<u64>(size, k_cacheLineSize) / k_cacheLineSize) - 1] : k_invalidTableIndex;
+        }
+
+        u64 aligmentedSize = alignUp<u64>(size, DEFAULT_ALIGMENT);
+        if (aligment != DEFAULT_ALIGMENT || aligmentedSize > k_maxSizeSmallTableAllocation)
+        {
+            return k_invalidTableIndex;
+        }
+
+        return m_sizeClassIndex._smallTableIndex[(aligmentedSize >> 2) - 1];
+    }
+
+    address_ptr MemoryPool::allocateFromSmallTable(u32 tableIndex)
+    {
+        PoolTable& table = m_smallPoolTables[tableIndex];
+        if (table._activePools.empty() && table._remoteFreeCount.load(std::memory_order_relaxed) > 0)
+        {
+            MemoryPool::drainRemoteFree(table);
+        }
+
+        Pool* pool = nullptr;
+        if (table._activePools.empty())
+        {
+            pool = MemoryPool::takeStalePool(table);
+            if (!pool)
+            {
+                pool = MemoryPool::allocateSmallPool(&table);
+            }
+            table._activePools.insert(pool);
+        }
+        else
+        {
+            pool = table._activePools.begin();
+            if (pool->isEmpty())
+            {
+                assert(table._countEmptyPools > 0);
+                --table._countEmptyPools;
+            }
+        }
+        assert(!pool->isFull());
+
+        address_ptr ptr = nullptr;
+        if (pool->isSlab())
+        {
+            ptr = MemoryPool::allocateFromSlab(pool);
+        }
+        else
+        {
+            //recycled blocks first, then carve a new one
+            Block* block = nullptr;
+            if (!pool->_free.empty())
+            {
+                block = pool->_free.begin();
+                pool->_free.erase(block);
+            }
+            else
+            {
+                assert(pool->_countCarved < pool->_countBlocks);
+                address_ptr memoryBlock = reinterpret_cast<address_ptr>(reinterpret_cast<u64>(pool->ptr()) + pool->_countCarved * pool->slotSize());
+                block = initBlock(memoryBlock, pool, pool->slotSize());
+                ++pool->_countCarved;
+            }
+
+            assert(block->_size == pool->_blockSize + sizeof(Block));
+            pool->_used.insert(block);
+            ++pool->_countUsed;
+            ptr = block->ptr();
+        }
+
+        if (pool->isFull())
+        {
+            table._activePools.erase(pool);
+            table._fullPools.insert(pool);
+        }
+
+        return ptr;
+    }
+
+    address_ptr MemoryPool::allocateFromSlab(Pool* pool)
+    {
+        u32 countWords = (pool->_countBlocks + 63) >> 6;
+        for (u32 i = pool->_searchIndex; i < countWords; ++i)
+        {
+            if (u64 word = pool->_bitmap[i]; word)
+            {
+                u32 bit = bitScanForward(word);
+                pool->_bitmap[i] = word & (word - 1);
+                pool->_searchIndex = i;
+                ++pool->_countUsed;
+
+                u64 slot = pool->_slabs + ((static_cast<u64>(i) << 6) + bit) * pool->slotSize();
+                if (u64 headerSize = pool->slotSize() - pool->_blockSize; headerSize > 0)
+                {
+                    slot += headerSize;
+                    *reinterpret_cast<Pool**>(slot - sizeof(Pool*)) = pool;
+                }
+
+                return reinterpret_cast<address_ptr>(slot);
+            }
+        }
+
+        assert(false && "slab is full");
+        return nullptr;
+    }
+
+    MemoryPool::MediumBlock* MemoryPool::allocateFromTable(u64 aligmentedSize)
+    {
+        if (m_poolTable._remoteFreeCount.load(std::memory_order_relaxed) > 0)
+        {
+            MemoryPool::drainRemoteFree(m_poolTable);
+        }
+
+        //keep blocks aligned, the user memory right after the header is aligned as well
+        u64 requestedSize = alignUp<u64>(aligmentedSize + sizeof(MediumBlock), DEFAULT_ALIGMENT);
+        FreeMediumBlock* block = m_freeBlockIndex.find(requestedSize);
+        if (!block)
+        {
+            //create new pool, medium pools are never full for the table, free blocks are in the index
+            Pool* pool = MemoryPool::takeStalePool(m_poolTable);
+            if (!pool)
+            {
+                pool = MemoryPool::allocatePool(&m_poolTable, DEFAULT_ALIGMENT);
+            }
+            m_poolTable._activePools.insert(pool);
+            ++m_poolTable._countEmptyPools;
+
+            block = reinterpret_cast<FreeMediumBlock*>(pool->ptr());
+        }
+        m_freeBlockIndex.erase(block);
+
+        Pool* pool = block->_pool;
+        if (pool->isEmpty())
+        {
+            assert(m_poolTable._countEmptyPools > 0);
+            --m_poolTable._countEmptyPools;
+        }
+
+        u64 blockSize = block->size();
+        assert(blockSize >= requestedSize);
+
+        //small remainder can't serve a medium request yet, but it merges with the neighbours once they are freed
+        u64 freeMemory = blockSize - requestedSize;
+        if (freeMemory >= k_minSizeMediumSplit)
+        {
+            blockSize = requestedSize;
+            MemoryPool::insertFreeMediumBlock(reinterpret_cast<address_ptr>(reinterpret_cast<u64>(block) + requestedSize), pool, freeMemory);
+        }
+        else if (MediumBlock* next = block->next(); reinterpret_cast<u64>(next) < reinterpret_cast<u64>(pool) + pool->_poolSize)
+        {
+            next->_size &= ~MediumBlock::k_prevFreeBit;
+        }
+        block->_size = static_cast<u32>(blockSize); //used, previous block is used as well
+        block->_requestedSize = static_cast<u32>(aligmentedSize);
+
+        ++pool->_countUsed;
+        pool->_blockSize += blockSize;
+        pool->_requestedSize += aligmentedSize;
+        assert(pool->_blockSize <= pool->_poolSize);
+
+        return block;
+    }
+
+    MemoryPool::FreeBlockIndex::FreeBlockIndex() noexcept
+        : _firstLevelMap(0)
+    {
+        _secondLevelMap.fill(0);
+    }
+
+    void MemoryPool::FreeBlockIndex::mapping(u64 size, u32& firstLevel, u32& secondLevel)
+    {
+        if (size < k_secondLevels)
+        {
+            firstLevel = 0;
+            secondLevel = static_cast<u32>(size);
+        }
+        else
+        {
+            firstLevel = bitScanReverse(size);
+            secondLevel = static_cast<u32>(size >> (firstLevel - k_secondLevelsLog2)) ^ k_secondLevels;
+            firstLevel -= k_secondLevelsLog2 - 1;
+        }
+        assert(firstLevel < k_firstLevels && secondLevel < k_secondLevels);
+    }
+
+    void MemoryPool::FreeBlockIndex::insert(FreeMediumBlock* block)
+    {
+        u32 firstLevel = 0;
+        u32 secondLevel = 0;
+        FreeBlockIndex::mapping(block->size(), firstLevel, secondLevel);
+
+        _lists[firstLevel][secondLevel].insert(block);
+        _firstLevelMap |= 1U << firstLevel;
+        _secondLevelMap[firstLevel] |= 1U << secondLevel;
+    }
+
+    void MemoryPool::FreeBlockIndex::erase(FreeMediumBlock* block)
+    {
+        assert(block->isFree());
+        u32 firstLevel = 0;
+        u32 secondLevel = 0;
+        FreeBlockIndex::mapping(block->size(), firstLevel, secondLevel);
+
+        List<FreeMediumBlock>& list = _lists[firstLevel][secondLevel];
+        list.erase(block);
+        block->_prev = nullptr;
+        block->_next = nullptr;
+
+        if (list.empty())
+        {
+            _secondLevelMap[firstLevel] &= ~(1U << secondLevel);
+            if (!_secondLevelMap[firstLevel])
+            {
+                _firstLevelMap &= ~(1U << firstLevel);
+            }
+        }
+    }
+
+    MemoryPool::FreeMediumBlock* MemoryPool::FreeBlockIndex::find(u64 size)
+    {
+        //round up to the next range, any block of the found list fits
+        u64 searchSize = size;
+        if (searchSize >= k_secondLevels)
+        {
+            searchSize += (1ULL << (bitScanReverse(searchSize) - k_secondLevelsLog2)) - 1;
+        }
+
+        u32 firstLevel = 0;
+        u32 secondLevel = 0;
+        FreeBlockIndex::mapping(searchSize, firstLevel, secondLevel);
+
+        u32 secondLevelMap = _secondLevelMap[firstLevel] & (~0U << secondLevel);
+        if (!secondLevelMap)
+        {
+            u32 firstLevelMap = (firstLevel + 1 < k_firstLevels) ? _firstLevelMap & (~0U << (firstLevel + 1)) : 0;
+            if (!firstLevelMap)
+            {
+                return nullptr;
+            }
+
+            firstLevel = bitScanForward(firstLevelMap);
+            secondLevelMap = _secondLevelMap[firstLevel];
+        }
+        secondLevel = bitScanForward(secondLevelMap);
+
+        FreeMediumBlock* block = _lists[firstLevel][secondLevel].begin();
+        assert(block->size() >= size);
+        return block;
+    }
+
+    void MemoryPool::FreeBlockIndex::clear()
+    {
+        for (auto& lists : _lists)
+        {
+            for (auto& list : lists)
+            {
+                list.clear();
+            }
+        }
+        _firstLevelMap = 0;
+        _secondLevelMap.fill(0);
+    }
+
+    void MemoryPool::collectStatistic()
+    {
+#if ENABLE_STATISTIC
+        std::cout << "Pool Statistic" << std::endl;
+        std::cout << "Time alloc/dealloc (ms): " << (f64)m_statistic._allocateTime / 1000.0 << "/" << (f64)m_statistic._dealocateTime / 1000.0 << std::endl;
+        std::cout << "Count Allocation : " << m_statistic._generalAllocationCount << ". Size (byte): " << m_statistic._generalAllocationSize << std::endl;
+        std::cout << "Pool Staticstic:" << std::endl;
+        std::cout << " SmallTable - Sizes/PoolSizes (byte): " << m_statistic._tableAllocationSizes[0] << "/" << m_statistic._poolAllocationSizes[0] 
+            << " Count Allocations/Pools: " << m_statistic._tableAllocationCount[0] << "/" << m_statistic._poolsAllocationCount[0] << std::endl;
+        std::cout << " PoolTable - Sizes/PoolSizes (byte): " << m_statistic._tableAllocationSizes[1] << "/" << m_statistic._poolAllocationSizes[1]
+            << " Count Allocations/Pools: " << m_statistic._tableAllocationCount[1] << "/" << m_statistic._poolsAllocationCount[1] << std::endl;
+        std::cout << " LargeAllocations - Sizes/PoolSizes (byte): " << m_statistic._tableAllocationSizes[2] << "/" << m_statistic._poolAllocationSizes[2]
+            << " Count Allocations/Pools: " << m_statistic._tableAllocationCount[2] << "/" << m_statistic._poolsAllocationCount[2] << std::endl;
+        std::cout << " LargeCache - Hits/Misses/Releases: " << m_largeCacheStatistic._hits << "/" << m_largeCacheStatistic._misses << "/" << m_largeCacheStatistic._releases
+            << " Cached (byte): " << m_largeCachedSize << std::endl;
+        std::cout << "PoolTable Fragmentation - Requested/Reserved/PoolSize (byte):" << std::endl;
+        for (const PoolFragmentation& fragmentation : MemoryPool::getMediumFragmentation())
+        {
+            std::cout << " " << fragmentation._requestedSize << "/" << fragmentation._reservedSize << "/" << fragmentation._poolSize << std::endl;
+        }
+#endif //ENABLE_STATISTIC
+    }
+
+    std::vector<MemoryPool::PoolFragmentation> MemoryPool::getMediumFragmentation()
+    {
+        std::vector<PoolFragmentation> fragmentation;
+        for (Pool* pool = m_poolTable._activePools.begin(); pool != m_poolTable._activePools.end(); pool = pool->_next)
+        {
+            fragmentation.push_back({ pool->_requestedSize, pool->_blockSize, pool->_poolSize });
+        }
+
+        return fragmentation;
+    }
+
+    static const u64 k_threadCacheBatchSize = 16'384;
+    static const u32 k_threadCacheMinBatchCount = 2;
+    static const u32 k_threadCacheMaxBatchCount = 64;
+
+    MemoryPool::ThreadCache::ThreadCache(MemoryPool& pool) noexcept
+        : m_pool(pool)
+    {
+        m_bins.resize(m_pool.m_smallPoolTables.size());
+        for (u32 i = 0; i < m_bins.size(); ++i)
+        {
+            Bin& bin = m_bins[i];
+            bin._head = nullptr;
+            bin._count = 0;
+            bin._batchSize = std::clamp<u32>(static_cast<u32>(k_threadCacheBatchSize / m_pool.m_smallPoolTables[i]._size), k_threadCacheMinBatchCount, k_threadCacheMaxBatchCount);
+        }
+    }
+
+    MemoryPool::ThreadCache::~ThreadCache()
+    {
+        ThreadCache::flush();
+    }
+
+    address_ptr MemoryPool::ThreadCache::allocMemory(u64 size, u32 aligment)
+    {
+        assert(size);
+        if (aligment <= DEFAULT_ALIGMENT) //default
+        {
+            aligment = DEFAULT_ALIGMENT;
+        }
+
+        //aligned pointer inside a bigger block if there are no size classes for the aligment
+        u32 tableIndex = m_pool.getSmallTableIndex(size, aligment);
+        bool alignInBlock = tableIndex == k_invalidTableIndex && aligment != DEFAULT_ALIGMENT;
+        if (alignInBlock)
+        {
+            tableIndex = m_pool.getSmallTableIndex(m_pool.getAlignedAllocationSize(size, aligment), DEFAULT_ALIGMENT);
+        }
+
+        if (tableIndex == k_invalidTableIndex)
+        {
+            std::lock_guard<std::mutex> lock(m_pool.m_mutex);
+            return m_pool.allocMemory(size, aligment);
+        }
+
+        Bin& bin = m_bins[tableIndex];
+        if (!bin._head)
+        {
+            ThreadCache::refillBin(bin, tableIndex);
+        }
+
+        //cached blocks are linked through the first bytes of the user memory
+        address_ptr ptr = bin._head;
+        bin._head = *reinterpret_cast<address_ptr*>(ptr);
+        --bin._count;
+
+        return alignInBlock ? m_pool.alignBlockMemory(ptr, aligment) : ptr;
+    }
+
+    void MemoryPool::ThreadCache::freeMemory(address_ptr memory)
+    {
+        Pool* pool = m_pool.getPool(memory);
+        if (!pool || pool->_table->_type == PoolTable::Default)
+        {
+            std::lock_guard<std::mutex> lock(m_pool.m_mutex);
+            m_pool.freeMemoryLocal(memory);
+            return;
+        }
+
+        u64 tableIndex = pool->_table - m_pool.m_smallPoolTables.data();
+        assert(tableIndex < m_bins.size() && "block is not from this pool");
+        Bin& bin = m_bins[tableIndex];
+
+        //bins keep the block start, aligned pointers are inside the block
+        memory = m_pool.getBlockMemory(pool, memory);
+        *reinterpret_cast<address_ptr*>(memory) = bin._head;
+        bin._head = memory;
+        ++bin._count;
+
+        if (bin._count > bin._batchSize * 2)
+        {
+            ThreadCache::flushBin(bin, bin._batchSize);
+        }
+    }
+
+    void MemoryPool::ThreadCache::flush()
+    {
+        for (auto& bin : m_bins)
+        {
+            if (bin._count > 0)
+            {
+                ThreadCache::flushBin(bin, bin._count);
+            }
+        }
+    }
+
+    void MemoryPool::ThreadCache::refillBin(Bin& bin, u32 tableIndex)
+    {
+        std::lock_guard<std::mutex> lock(m_pool.m_mutex);
+
+        for (u32 i = 0; i < bin._batchSize; ++i)
+        {
+            address_ptr ptr = m_pool.allocateFromSmallTable(tableIndex);
+            assert(ptr);
+#if ENABLE_STATISTIC
+            m_pool.m_statistic.registerAllocation<0>(m_pool.getPool(ptr)->slotSize());
+#endif //ENABLE_STATISTIC
+
+            *reinterpret_cast<address_ptr*>(ptr) = bin._head;
+            bin._head = ptr;
+        }
+        bin._count += bin._batchSize;
+    }
+
+    void MemoryPool::ThreadCache::flushBin(Bin& bin, u32 count)
+    {
+        std::lock_guard<std::mutex> lock(m_pool.m_mutex);
+
+        assert(count <= bin._count);
+        for (u32 i = 0; i < count; ++i)
+        {
+            address_ptr ptr = bin._head;
+            bin._head = *reinterpret_cast<address_ptr*>(ptr);
+
+            m_pool.freePoolMemory(m_pool.getPool(ptr), ptr);
+        }
+        bin._count -= count;
+    }
+
+
+    DefaultMemoryAllocator::~DefaultMemoryAllocator()
+    {
+        PageCache::getInstance().clear(this);
+    }
+
+    address_ptr DefaultMemoryAllocator::allocate(u64 size, u32 aligment, void* user)
+    {
+#if defined(_MSC_VER)
+        address_ptr ptr = _aligned_malloc(size, std::max<u32>(aligment, MAX_ALIGMENT));
+#else
+        address_ptr ptr = nullptr;
+        if (aligment <= MAX_ALIGMENT)
+        {
+            ptr = malloc(size);
+        }
+        else if (posix_memalign(&ptr, aligment, size) != 0)
+        {
+            ptr = nullptr;
+        }
+#endif
+        assert(ptr && "Invalid allocate");
+
+#if DEBUG_MEMORY
+        memset(ptr, 'X', size);
+#endif //DEBUG_MEMORY
+        return ptr;
+    }
+
+    void DefaultMemoryAllocator::deallocate(address_ptr memory, u64 size, void* user)
+    {
+        assert(memory && "Invalid block");
+#if defined(_MSC_VER)
+        _aligned_free(memory);
+#else
+        free(memory);
+#endif
+    }
+
+    address_ptr DefaultMemoryAllocator::reallocate(address_ptr memory, u64 size, u64 newSize, void* user)
+    {
+        assert(memory && "Invalid block");
+        //default aligment only, large blocks are moved by remapping pages
+#if defined(_MSC_VER)
+        return _aligned_realloc(memory, newSize, MAX_ALIGMENT);
+#else
+        return realloc(memory, newSize);
+#endif
+    }
+
+#if defined(__linux__)
+    LinuxVirtualMemoryAllocator::LinuxVirtualMemoryAllocator(u64 reserveSize, PurgeMode mode, bool hugePages) noexcept
+        : m_reserve(nullptr)
+        , m_reserveSize(0)
+        , m_pageSize(hugePages ? k_hugePageSize : static_cast<u64>(sysconf(_SC_PAGESIZE)))
+        , m_mode(mode)
+        , m_hugePages(hugePages)
+        , m_hugeTlbAvailable(hugePages)
+        , m_statistic()
+    {
+        //address space only, pages are committed by the first touch. Over reserve to align the range to the page size
+        u64 systemPageSize = static_cast<u64>(sysconf(_SC_PAGESIZE));
+        u64 mapSize = alignUp<u64>(reserveSize, m_pageSize) + m_pageSize - systemPageSize;
+        address_ptr reserve = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (reserve == MAP_FAILED)
+        {
+            return;
+        }
+
+        u64 address = reinterpret_cast<u64>(reserve);
+        u64 alignedAddress = alignUp<u64>(address, m_pageSize);
+        if (alignedAddress > address)
+        {
+            munmap(reserve, alignedAddress - address);
+        }
+        m_reserveSize = alignDown<u64>(address + mapSize - alignedAddress, m_pageSize);
+        if (u64 tail = address + mapSize - (alignedAddress + m_reserveSize); tail > 0)
+        {
+            munmap(reinterpret_cast<address_ptr>(alignedAddress + m_reserveSize), tail);
+        }
+        m_reserve = reinterpret_cast<address_ptr>(alignedAddress);
+
+#if defined(MADV_HUGEPAGE)
+        if (m_hugePages)
+        {
+            madvise(m_reserve, m_reserveSize, MADV_HUGEPAGE);
+        }
+#endif //MADV_HUGEPAGE
+
+        m_statistic._reservedSize = m_reserveSize;
+        LinuxVirtualMemoryAllocator::insertRange(alignedAddress, m_reserveSize);
+    }
+
+    LinuxVirtualMemoryAllocator::~LinuxVirtualMemoryAllocator()
+    {
+        PageCache::getInstance().clear(this);
+        assert(m_statistic._usedSize == 0 && m_statistic._externalSize == 0 && "memory is still used");
+        if (m_reserve)
+        {
+            munmap(m_reserve, m_reserveSize);
+        }
+    }
 
-            if (k_deleteUnusedPools)
+    address_ptr LinuxVirtualMemoryAllocator::allocate(u64 size, u32 aligment, void* user)
+    {
+        u64 allocationSize = alignUp<u64>(size, m_pageSize);
+        u64 allocationAligment = std::max<u64>(aligment, m_pageSize);
+#if defined(MAP_HUGETLB)
+        //explicit huge pages are mapped and committed at once, the mapping fails if the system has no free huge pages
+        if (m_hugePages && allocationAligment == k_hugePageSize && m_hugeTlbAvailable.load(std::memory_order_relaxed))
+        {
+            address_ptr memory = mmap(nullptr, allocationSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (memory != MAP_FAILED)
+            {
+                m_hugeTlbMappings.emplace(reinterpret_cast<u64>(memory), allocationSize);
+                m_statistic._externalSize += allocationSize;
+                m_statistic._hugeTlbSize += allocationSize;
+                return memory;
+            }
+            m_hugeTlbAvailable.store(false, std::memory_order_relaxed);
+        }
+#endif //MAP_HUGETLB
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (u64 address = LinuxVirtualMemoryAllocator::takeRange(allocationSize, allocationAligment); address)
             {
-                auto& pools = const_cast<decltype(pool->_table->_activePools)&>(pool->_table->_activePools);
+                m_statistic._usedSize += allocationSize;
+                return reinterpret_cast<address_ptr>(address);
+            }
+        }
 
-                collectEmptyPools(pools, m_markedToDelete);
-                if (m_markedToDelete.size() > 0)
-                {
-                    for (auto& pool : m_markedToDelete)
-                    {
-#if ENABLE_STATISTIC
-                        m_statistic.registerPoolDeallocation<0>(pool->_poolSize);
-#endif //ENABLE_STATISTIC
-                        MemoryPool::deallocatePool(pool);
-                    }
-                    m_markedToDelete.clear();
-                }
+        //reserve is exhausted
+        return LinuxVirtualMemoryAllocator::mapExternal(allocationSize, allocationAligment);
+    }
+
+    address_ptr LinuxVirtualMemoryAllocator::mapExternal(u64 size, u64 aligment)
+    {
+        //over map and trim to the aligment
+        u64 systemPageSize = static_cast<u64>(sysconf(_SC_PAGESIZE));
+        u64 mapSize = size + aligment - systemPageSize;
+        address_ptr memory = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        assert(memory != MAP_FAILED && "Invalid allocate");
+        if (memory == MAP_FAILED)
+        {
+            return nullptr;
+        }
+
+        u64 address = reinterpret_cast<u64>(memory);
+        u64 alignedAddress = alignUp<u64>(address, aligment);
+        if (alignedAddress > address)
+        {
+            munmap(memory, alignedAddress - address);
+        }
+        if (u64 tail = address + mapSize - (alignedAddress + size); tail > 0)
+        {
+            munmap(reinterpret_cast<address_ptr>(alignedAddress + size), tail);
+        }
+#if defined(MADV_HUGEPAGE)
+        if (m_hugePages)
+        {
+            madvise(reinterpret_cast<address_ptr>(alignedAddress), size, MADV_HUGEPAGE);
+        }
+#endif //MADV_HUGEPAGE
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_statistic._externalSize += size;
+        return reinterpret_cast<address_ptr>(alignedAddress);
+    }
+
+    void LinuxVirtualMemoryAllocator::deallocate(address_ptr memory, u64 size, void* user)
+    {
+        assert(memory && size && "Invalid block");
+        u64 allocationSize = alignUp<u64>(size, m_pageSize);
+        if (!LinuxVirtualMemoryAllocator::owns(memory))
+        {
+            int result = munmap(memory, allocationSize);
+            assert(result == 0);
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_statistic._externalSize -= allocationSize;
+            if (m_hugeTlbMappings.erase(reinterpret_cast<u64>(memory)) > 0)
+            {
+                m_statistic._hugeTlbSize -= allocationSize;
+                m_hugeTlbAvailable.store(true, std::memory_order_relaxed);
             }
+            return;
         }
-        else
+
+        //address range is kept, only the pages are returned
+        LinuxVirtualMemoryAllocator::purgeRange(reinterpret_cast<u64>(memory), allocationSize);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_statistic._usedSize -= allocationSize;
+        LinuxVirtualMemoryAllocator::releaseRange(reinterpret_cast<u64>(memory), allocationSize);
+    }
+
+    address_ptr LinuxVirtualMemoryAllocator::reallocate(address_ptr memory, u64 size, u64 newSize, void* user)
+    {
+        assert(memory && size && "Invalid block");
+        u64 allocationSize = alignUp<u64>(size, m_pageSize);
+        u64 newAllocationSize = alignUp<u64>(newSize, m_pageSize);
+        if (!LinuxVirtualMemoryAllocator::owns(memory))
         {
-            assert(pool->_table->_type == PoolTable::Default);
-            u64 blockSize = block->_size;
-            //pool->_free.insert(block);
-            pool->_free.priorityInsert(block);
-            pool->_free.merge();
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_hugeTlbMappings.count(reinterpret_cast<u64>(memory)) > 0)
+            {
+                //huge page mappings are not remapped
+                return newAllocationSize == allocationSize ? memory : nullptr;
+            }
+            lock.unlock();
 
-            assert(pool->_blockSize >= blockSize);
-            pool->_blockSize -= blockSize;
+            address_ptr newMemory = mremap(memory, allocationSize, newAllocationSize, MREMAP_MAYMOVE);
+            if (newMemory == MAP_FAILED)
+            {
+                return nullptr;
+            }
 
-#if ENABLE_STATISTIC
-            m_statistic.registerDeallocation<1>(blockSize);
-#endif //ENABLE_STATISTIC
+            lock.lock();
+            m_statistic._externalSize = m_statistic._externalSize - allocationSize + newAllocationSize;
+            return newMemory;
+        }
 
-            if (k_deleteUnusedPools)
+        u64 address = reinterpret_cast<u64>(memory);
+        if (newAllocationSize <= allocationSize)
+        {
+            if (newAllocationSize < allocationSize)
             {
-                collectEmptyPools(m_poolTable._activePools, m_markedToDelete);
-                if (m_markedToDelete.size() > 0)
-                {
-                    for (auto& pool : m_markedToDelete)
-                    {
-#if ENABLE_STATISTIC
-                        m_statistic.registerPoolDeallocation<1>(pool->_poolSize);
-#endif //ENABLE_STATISTIC
-                        MemoryPool::deallocatePool(pool);
-                    }
+                LinuxVirtualMemoryAllocator::purgeRange(address + newAllocationSize, allocationSize - newAllocationSize);
 
-                    m_markedToDelete.clear();
-                }
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_statistic._usedSize -= allocationSize - newAllocationSize;
+                LinuxVirtualMemoryAllocator::releaseRange(address + newAllocationSize, allocationSize - newAllocationSize);
             }
+
+            return memory;
         }
+
+        //grow in place into the next free range
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto next = m_freeRanges.find(address + allocationSize);
+        u64 growSize = newAllocationSize - allocationSize;
+        if (next == m_freeRanges.end() || next->second < growSize)
+        {
+            return nullptr;
+        }
+
+        u64 nextAddress = next->first;
+        u64 nextSize = next->second;
+        LinuxVirtualMemoryAllocator::eraseRange(nextAddress, nextSize);
+        if (nextSize > growSize)
+        {
+            LinuxVirtualMemoryAllocator::insertRange(nextAddress + growSize, nextSize - growSize);
+        }
+        m_statistic._usedSize += growSize;
+
+        return memory;
     }
 
-    MemoryPool::Block* MemoryPool::allocateFromSmallTables(u64 aligmentedSize)
+    bool LinuxVirtualMemoryAllocator::purge(address_ptr memory, u64 size, void* user)
     {
-        assert(aligmentedSize <= std::numeric_limits<u32>::max());
-        u32 index = (static_cast<u32>(aligmentedSize) >> 2) - 1;
-        u32 tableIndex = m_smallTableIndex[index];
+        assert(memory && size && "Invalid block");
+        u64 address = reinterpret_cast<u64>(memory);
+        if (!LinuxVirtualMemoryAllocator::owns(memory))
+        {
+            //huge page mappings are committed at once and kept until unmapped
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto mapping = m_hugeTlbMappings.upper_bound(address);
+            if (mapping != m_hugeTlbMappings.begin() && address < std::prev(mapping)->first + std::prev(mapping)->second)
+            {
+                return false;
+            }
+        }
 
-        PoolTable& table = m_smallPoolTables[tableIndex];
-        if (Pool* pool = nullptr; table._activePools.empty())
+        //only whole pages inside the range are returned
+        u64 systemPageSize = static_cast<u64>(sysconf(_SC_PAGESIZE));
+        u64 start = alignUp<u64>(address, systemPageSize);
+        u64 end = alignDown<u64>(address + size, systemPageSize);
+        if (end > start)
         {
-            pool = MemoryPool::allocateFixedBlocksPool(&table, DEFAULT_ALIGMENT);
-            table._activePools.insert(pool);
+            LinuxVirtualMemoryAllocator::purgeRange(start, end - start);
+        }
 
-            Block* block = pool->_free.begin();
-            pool->_free.erase(block);
-            pool->_used.insert(block);
+        return true;
+    }
 
-            return block;
+    bool LinuxVirtualMemoryAllocator::owns(address_ptr memory) const
+    {
+        u64 address = reinterpret_cast<u64>(memory);
+        u64 reserve = reinterpret_cast<u64>(m_reserve);
+        return m_reserve && address >= reserve && address < reserve + m_reserveSize;
+    }
+
+    u64 LinuxVirtualMemoryAllocator::getMemoryPoolPageSize(u64 pageSize) const
+    {
+        if (!m_hugePages)
+        {
+            return pageSize;
         }
-        else
+
+        return alignUp<u64>(pageSize * MemoryPool::k_countPagesPerAllocation, k_hugePageSize) / MemoryPool::k_countPagesPerAllocation;
+    }
+
+    LinuxVirtualMemoryAllocator::Statistic LinuxVirtualMemoryAllocator::getStatistic() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_statistic;
+    }
+
+    u64 LinuxVirtualMemoryAllocator::takeRange(u64 size, u64 aligment)
+    {
+        //best fit, the untouched tail of the reserve is the biggest range and is taken last
+        for (auto range = m_freeRangesBySize.lower_bound(size); range != m_freeRangesBySize.end(); ++range)
         {
-            pool = table._activePools.begin();
-            assert(!pool->_free.empty());
+            u64 rangeAddress = range->second;
+            u64 rangeSize = range->first;
+            u64 address = alignUp<u64>(rangeAddress, aligment);
+            if (address + size > rangeAddress + rangeSize)
+            {
+                continue;
+            }
 
-            Block* block = pool->_free.begin();
-            assert(block != pool->_free.end());
+            LinuxVirtualMemoryAllocator::eraseRange(rangeAddress, rangeSize);
+            if (address > rangeAddress)
+            {
+                LinuxVirtualMemoryAllocator::insertRange(rangeAddress, address - rangeAddress);
+            }
+            if (u64 tail = rangeAddress + rangeSize - (address + size); tail > 0)
+            {
+                LinuxVirtualMemoryAllocator::insertRange(address + size, tail);
+            }
 
-            assert(block->_size == pool->_blockSize + sizeof(Block));
-            pool->_free.erase(block);
-            pool->_used.insert(block);
+            return address;
+        }
+
+        return 0;
+    }
+
+    void LinuxVirtualMemoryAllocator::insertRange(u64 address, u64 size)
+    {
+        m_freeRanges.emplace(address, size);
+        m_freeRangesBySize.emplace(size, address);
+    }
 
-            if (pool->_free.empty())
+    void LinuxVirtualMemoryAllocator::eraseRange(u64 address, u64 size)
+    {
+        m_freeRanges.erase(address);
+
+        auto ranges = m_freeRangesBySize.equal_range(size);
+        for (auto range = ranges.first; range != ranges.second; ++range)
+        {
+            if (range->second == address)
             {
-                table._activePools.erase(pool);
-                table._fullPools.insert(pool);
+                m_freeRangesBySize.erase(range);
+                return;
             }
+        }
+        assert(false && "range is not found");
+    }
 
-            return block;
+    void LinuxVirtualMemoryAllocator::releaseRange(u64 address, u64 size)
+    {
+        //merge with the free neighbours
+        auto next = m_freeRanges.lower_bound(address);
+        if (next != m_freeRanges.end() && next->first == address + size)
+        {
+            u64 nextSize = next->second;
+            LinuxVirtualMemoryAllocator::eraseRange(address + size, nextSize);
+            size += nextSize;
         }
 
-        assert(false);
-        return nullptr;
+        next = m_freeRanges.lower_bound(address);
+        if (next != m_freeRanges.begin())
+        {
+            auto prev = std::prev(next);
+            if (prev->first + prev->second == address)
+            {
+                u64 prevAddress = prev->first;
+                u64 prevSize = prev->second;
+                LinuxVirtualMemoryAllocator::eraseRange(prevAddress, prevSize);
+                address = prevAddress;
+                size += prevSize;
+            }
+        }
+
+        LinuxVirtualMemoryAllocator::insertRange(address, size);
     }
 
-    MemoryPool::Block* MemoryPool::allocateFromTable(u64 aligmentedSize)
+    void LinuxVirtualMemoryAllocator::purgeRange(u64 address, u64 size)
     {
-        for (Pool* pool = m_poolTable._activePools.begin(); pool != m_poolTable._activePools.end(); pool = pool->_next)
+        int result = -1;
+#if defined(MADV_FREE)
+        if (m_mode == PurgeMode::Free)
+        {
+            result = madvise(reinterpret_cast<address_ptr>(address), size, MADV_FREE);
+        }
+#endif //MADV_FREE
+        if (result != 0)
+        {
+            result = madvise(reinterpret_cast<address_ptr>(address), size, MADV_DONTNEED);
+        }
+        assert(result == 0);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_statistic._purgedSize += size;
+    }
+#endif //__linux__
+
+
+    PageCache::PageCache() noexcept
+        : m_retentionLimit(k_defaultRetentionLimit)
+        , m_cachedSize(0)
+        , m_hits(0)
+        , m_misses(0)
+        , m_releases(0)
+        , m_overflows(0)
+    {
+        for (Slot& slot : m_slots)
+        {
+            slot._span.store(nullptr, std::memory_order_relaxed);
+            slot._allocator.store(nullptr, std::memory_order_relaxed);
+            slot._key.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    PageCache::~PageCache()
+    {
+        PageCache::clear();
+    }
+
+    PageCache& PageCache::getInstance()
+    {
+        //never destroyed, allocators can be destroyed after it on exit
+        static PageCache* s_pageCache = new PageCache();
+        return *s_pageCache;
+    }
+
+    address_ptr PageCache::acquireSpan(MemoryPool::MemoryAllocator* allocator, u64 size, void* user, u32 aligment)
+    {
+        if (m_cachedSize.load(std::memory_order_relaxed) < size)
+        {
+            m_misses.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        u64 key = PageCache::getSpanKey(allocator, size, user);
+        Slot* bucket = PageCache::getBucket(key);
+        for (Slot* slot = bucket; slot != bucket + k_countSlotsPerBucket; ++slot)
         {
-            assert(!pool->_free.empty());
-            Block* block = pool->_free.begin();
-            while (block != pool->_free.end())
+            //only a matching span is taken, others stay visible to concurrent acquires
+            address_ptr memory = slot->_span.load(std::memory_order_acquire);
+            if (!PageCache::isCachedSpan(memory) || slot->_key.load(std::memory_order_relaxed) != key)
             {
-                u64 requestedSize = aligmentedSize + sizeof(Block);
-                if (block->_size >= requestedSize)
-                {
-                    u64 freeMemory = block->_size - requestedSize;
-                    if (freeMemory > k_maxSizeSmallTableAllocation + sizeof(Block))
-                    {
-                        block->_size = requestedSize;
+                continue;
+            }
 
-                        address_ptr emptyMemory = (address_ptr)(reinterpret_cast<u64>(block) + requestedSize);
-                        Block* emptyBlock = initBlock(emptyMemory, pool, freeMemory);
-                        pool->_free.priorityInsert(emptyBlock);
-                    }
-                    pool->_free.erase(block);
-                    pool->_used.priorityInsert(block);
-                    pool->_blockSize += block->_size;
-                    assert(pool->_blockSize <= pool->_poolSize);
+            if (aligment != 0 && (reinterpret_cast<u64>(memory) & (aligment - 1)) != 0)
+            {
+                continue;
+            }
 
-                    if (pool->_free.empty())
-                    {
-                        m_poolTable._activePools.erase(pool);
-                        m_poolTable._fullPools.insert(pool);
-                    }
+            if (!slot->_span.compare_exchange_strong(memory, nullptr, std::memory_order_acquire, std::memory_order_relaxed))
+            {
+                continue;
+            }
 
-                    return block;
-                }
-                block = block->_next;
+            SpanHeader* header = reinterpret_cast<SpanHeader*>(memory);
+            if (header->_allocator == allocator && header->_size == size && header->_user == user)
+            {
+                m_cachedSize.fetch_sub(size, std::memory_order_relaxed);
+                m_hits.fetch_add(1, std::memory_order_relaxed);
+                return memory;
+            }
+
+            //the slot was refilled with the same address between the loads, put the span back
+            if (!PageCache::pushSpan(memory))
+            {
+                PageCache::deallocateSpan(memory);
             }
         }
 
-        //create new pool
-        Pool* pool = MemoryPool::allocatePool(&m_poolTable, DEFAULT_ALIGMENT);
-        m_poolTable._activePools.insert(pool);
+        m_misses.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
 
-        Block* block = pool->_free.begin();
-        assert(block != pool->_free.end());
+    bool PageCache::releaseSpan(MemoryPool::MemoryAllocator* allocator, address_ptr memory, u64 size, void* user)
+    {
+        assert(memory && size >= sizeof(SpanHeader));
+        if (m_cachedSize.fetch_add(size, std::memory_order_relaxed) + size > m_retentionLimit.load(std::memory_order_relaxed))
+        {
+            m_cachedSize.fetch_sub(size, std::memory_order_relaxed);
+            m_overflows.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
 
-        u64 requestedSize = aligmentedSize + sizeof(Block);
-        assert(block->_size >= requestedSize);
+        SpanHeader* header = reinterpret_cast<SpanHeader*>(memory);
+        header->_allocator = allocator;
+        header->_user = user;
+        header->_size = size;
 
-        u64 freeMemory = block->_size - requestedSize;
-        if (freeMemory > k_maxSizeSmallTableAllocation + sizeof(Block))
+        if (!PageCache::pushSpan(memory))
         {
-            block->_size = requestedSize;
-
-            address_ptr emptyMemory = (address_ptr)(reinterpret_cast<u64>(pool->ptr()) + requestedSize);
-            Block* emptyBlock = initBlock(emptyMemory, pool, freeMemory);
-            pool->_free.insert(emptyBlock);
+            m_cachedSize.fetch_sub(size, std::memory_order_relaxed);
+            m_overflows.fetch_add(1, std::memory_order_relaxed);
+            return false;
         }
 
-        pool->_free.erase(block);
-        pool->_used.insert(block);
-        pool->_blockSize += block->_size;
-        assert(pool->_blockSize <= pool->_poolSize);
+        m_releases.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
 
-        return block;
+    u64 PageCache::getSpanKey(MemoryPool::MemoryAllocator* allocator, u64 size, void* user)
+    {
+        u64 key = reinterpret_cast<u64>(allocator) * 0x9E3779B97F4A7C15ULL;
+        key ^= reinterpret_cast<u64>(user) * 0xC2B2AE3D27D4EB4FULL;
+        key ^= size * 0x165667B19E3779F9ULL;
+        return key ^ (key >> 29);
+    }
+
+    bool PageCache::isCachedSpan(address_ptr memory)
+    {
+        return reinterpret_cast<u64>(memory) > k_reservedSlot;
     }
 
-    void MemoryPool::collectEmptyPools(List<Pool>& pools, std::vector<Pool*>& markedToDelete)
+    PageCache::Slot* PageCache::getBucket(u64 key)
     {
-        bool skip = true;
-        markedToDelete.clear();
+        return m_slots.data() + (key % k_countBuckets) * k_countSlotsPerBucket;
+    }
 
-        Pool* pool = pools.begin();
-        while(pool != pools.end())
+    bool PageCache::pushSpan(address_ptr memory)
+    {
+        const SpanHeader* header = reinterpret_cast<const SpanHeader*>(memory);
+        u64 key = PageCache::getSpanKey(header->_allocator, header->_size, header->_user);
+        Slot* bucket = PageCache::getBucket(key);
+        for (Slot* slot = bucket; slot != bucket + k_countSlotsPerBucket; ++slot)
         {
-            if (pool->_used.empty())
+            //reserve the slot, the span is published after its key
+            address_ptr expected = nullptr;
+            if (!slot->_span.load(std::memory_order_relaxed) && slot->_span.compare_exchange_strong(expected, reinterpret_cast<address_ptr>(k_reservedSlot), std::memory_order_relaxed, std::memory_order_relaxed))
             {
-                if (skip) //skip first
-                {
-                    skip = false;
-                }
-                else
-                {
-                    markedToDelete.push_back(pool);
-                    pool = pools.erase(pool);
+                slot->_allocator.store(header->_allocator, std::memory_order_relaxed);
+                slot->_key.store(key, std::memory_order_relaxed);
+                slot->_span.store(memory, std::memory_order_release);
+                return true;
+            }
+        }
 
-                    continue;
-                }
+        return false;
+    }
+
+    address_ptr PageCache::takeSpan(Slot& slot, MemoryPool::MemoryAllocator* allocator)
+    {
+        //nullptr allocator takes a span of any allocator
+        address_ptr memory = slot._span.load(std::memory_order_acquire);
+        while (PageCache::isCachedSpan(memory) && (!allocator || slot._allocator.load(std::memory_order_relaxed) == allocator))
+        {
+            if (slot._span.compare_exchange_weak(memory, nullptr, std::memory_order_acquire, std::memory_order_acquire))
+            {
+                return memory;
             }
-            pool = pool->_next;
         }
+
+        return nullptr;
     }
 
-    void MemoryPool::collectStatistic()
+    void PageCache::deallocateSpan(address_ptr memory)
     {
-#if ENABLE_STATISTIC
-        std::cout << "Pool Statistic" << std::endl;
-        std::cout << "Time alloc/dealloc (ms): " << (f64)m_statistic._allocateTime / 1000.0 << "/" << (f64)m_statistic._dealocateTime / 1000.0 << std::endl;
-        std::cout << "Count Allocation : " << m_statistic._generalAllocationCount << ". Size (byte): " << m_statistic._generalAllocationSize << std::endl;
-        std::cout << "Pool Staticstic:" << std::endl;
-        std::cout << " SmallTable - Sizes/PoolSizes (byte): " << m_statistic._tableAllocationSizes[0] << "/" << m_statistic._poolAllocationSizes[0] 
-            << " Count Allocations/Pools: " << m_statistic._tableAllocationCount[0] << "/" << m_statistic._poolsAllocationCount[0] << std::endl;
-        std::cout << " PoolTable - Sizes/PoolSizes (byte): " << m_statistic._tableAllocationSizes[1] << "/" << m_statistic._poolAllocationSizes[1]
-            << " Count Allocations/Pools: " << m_statistic._tableAllocationCount[1] << "/" << m_statistic._poolsAllocationCount[1] << std::endl;
-        std::cout << " LargeAllocations - Sizes/PoolSizes (byte): " << m_statistic._tableAllocationSizes[2] << "/" << m_statistic._poolAllocationSizes[2]
-            << " Count Allocations/Pools: " << m_statistic._tableAllocationCount[2] << "/" << m_statistic._poolsAllocationCount[2] << std::endl;
-#endif //ENABLE_STATISTIC
+        SpanHeader header = *reinterpret_cast<SpanHeader*>(memory);
+        m_cachedSize.fetch_sub(header._size, std::memory_order_relaxed);
+        header._allocator->deallocate(memory, header._size, header._user);
     }
 
+    void PageCache::setRetentionLimit(u64 size)
+    {
+        m_retentionLimit.store(size, std::memory_order_relaxed);
+        if (m_cachedSize.load(std::memory_order_relaxed) > size)
+        {
+            PageCache::clear();
+        }
+    }
 
-    address_ptr DefaultMemoryAllocator::allocate(u64 size, u32 aligment, void* user)
+    u64 PageCache::getRetentionLimit() const
     {
-        address_ptr ptr = malloc(size);
-        assert(ptr && "Invalid allocate");
+        return m_retentionLimit.load(std::memory_order_relaxed);
+    }
 
-#if DEBUG_MEMORY
-        memset(ptr, 'X', size);
-#endif //DEBUG_MEMORY
-        return ptr;
+    void PageCache::clear()
+    {
+        for (Slot& slot : m_slots)
+        {
+            if (address_ptr memory = PageCache::takeSpan(slot, nullptr); memory)
+            {
+                PageCache::deallocateSpan(memory);
+            }
+        }
     }
 
-    void DefaultMemoryAllocator::deallocate(address_ptr memory, u64 size, void* user)
+    void PageCache::clear(MemoryPool::MemoryAllocator* allocator)
     {
-        assert(memory && "Invalid block");
-        free(memory);
+        for (Slot& slot : m_slots)
+        {
+            address_ptr memory = PageCache::takeSpan(slot, allocator);
+            if (!memory)
+            {
+                continue;
+            }
+
+            //the slot was refilled with the same address by another allocator
+            if (reinterpret_cast<SpanHeader*>(memory)->_allocator != allocator && PageCache::pushSpan(memory))
+            {
+                continue;
+            }
+            PageCache::deallocateSpan(memory);
+        }
+    }
+
+    void PageCache::forget(MemoryPool::MemoryAllocator* allocator)
+    {
+        for (Slot& slot : m_slots)
+        {
+            address_ptr memory = PageCache::takeSpan(slot, allocator);
+            if (!memory)
+            {
+                continue;
+            }
+
+            SpanHeader header = *reinterpret_cast<SpanHeader*>(memory);
+            if (header._allocator != allocator)
+            {
+                if (!PageCache::pushSpan(memory))
+                {
+                    PageCache::deallocateSpan(memory);
+                }
+                continue;
+            }
+
+            //the allocator is half destroyed, its spans can't be returned
+            assert(false && "spans of a destroyed allocator are leaked, call PageCache::getInstance().clear(this) in its destructor");
+            m_cachedSize.fetch_sub(header._size, std::memory_order_relaxed);
+        }
+    }
+
+    PageCache::Statistic PageCache::getStatistic() const
+    {
+        Statistic statistic;
+        statistic._hits = m_hits.load(std::memory_order_relaxed);
+        statistic._misses = m_misses.load(std::memory_order_relaxed);
+        statistic._releases = m_releases.load(std::memory_order_relaxed);
+        statistic._overflows = m_overflows.load(std::memory_order_relaxed);
+        statistic._cachedSize = m_cachedSize.load(std::memory_order_relaxed);
+
+        return statistic;
+    }
+
+    void PageCache::collectStatistic()
+    {
+        Statistic statistic = PageCache::getStatistic();
+        u64 requests = statistic._hits + statistic._misses;
+
+        std::cout << "PageCache Statistic" << std::endl;
+        std::cout << " Hits/Misses: " << statistic._hits << "/" << statistic._misses
+            << ". Hit rate: " << (requests ? (f64)statistic._hits * 100.0 / (f64)requests : 0.0) << "%" << std::endl;
+        std::cout << " Releases/Overflows: " << statistic._releases << "/" << statistic._overflows
+            << ". Cached size (byte): " << statistic._cachedSize << "/" << PageCache::getRetentionLimit() << std::endl;
     }
 
 } //namespace mem
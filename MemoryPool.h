@@ -1,16 +1,24 @@
 #pragma once
 
 #include <assert.h>
+#include <cstddef>
 #include <vector>
 #include <array>
 #include <list>
 #include <map>
+#include <set>
+#include <unordered_set>
+#include <mutex>
+#include <atomic>
+#include <thread>
 
 #define DEBUG_MEMORY 0
 #define ENABLE_STATISTIC 0
 
 namespace mem
 {
+    class ConcurrentMemoryPool;
+
     typedef unsigned short      u16;
     typedef signed int          s32;
     typedef unsigned int        u32;
@@ -37,21 +45,121 @@ namespace mem
         public:
 
             explicit MemoryAllocator() noexcept = default;
-            virtual ~MemoryAllocator() = default;
+
+            /*
+            * Drops spans of the allocator left in the PageCache, they can't be returned through a destroyed allocator.
+            * Allocators must free them in own destructor with PageCache::clear(this), dropped spans are leaked and assert
+            */
+            virtual ~MemoryAllocator();
 
             virtual address_ptr allocate(u64 size, u32 aligment = 0, void* user = nullptr) = 0;
             virtual void        deallocate(address_ptr memory, u64 size = 0, void* user = nullptr) = 0;
+
+            /*
+            * Resize allocation, content is kept. Return nullptr if not supported, the old memory stays valid then
+            */
+            virtual address_ptr reallocate(address_ptr memory, u64 size, u64 newSize, void* user = nullptr)
+            {
+                return nullptr;
+            }
+
+            /*
+            * Return the pages of an allocated range to the OS, the range stays allocated and reads zero or old content after.
+            * Return false if not supported, the pages stay committed then
+            */
+            virtual bool        purge(address_ptr memory, u64 size, void* user = nullptr)
+            {
+                return false;
+            }
+        };
+
+        /*
+        * class ThreadCache. Per thread front-end of the small tables
+        * Small blocks are served from local bins without locking, the pool is locked only to refill/flush a batch
+        * Create one cache per thread, the cache must be destroyed before the pool
+        */
+        class ThreadCache final
+        {
+        public:
+
+            ThreadCache(const ThreadCache&) = delete;
+            ThreadCache& operator=(const ThreadCache&) = delete;
+
+            explicit ThreadCache(MemoryPool& pool) noexcept;
+            ~ThreadCache();
+
+            /*
+            * Request free memory from thread cache
+            * param size: count bytes will be requested
+            * param aligment: aligment
+            */
+            address_ptr allocMemory(u64 size, u32 aligment = 0);
+
+            template<class T>
+            T* allocElement()
+            {
+                return reinterpret_cast<T*>(allocMemory(sizeof(T), alignof(T)));
+            }
+
+            template<class T>
+            T* allocArray(u64 count)
+            {
+                return reinterpret_cast<T*>(allocMemory(sizeof(T) * count, alignof(T)));
+            }
+
+            /*
+            * Return memory to thread cache
+            * param address_ptr: address of memory
+            */
+            void freeMemory(address_ptr memory);
+
+            /*
+            * Return all cached blocks to the pool
+            */
+            void flush();
+
+        private:
+
+            struct Bin
+            {
+                address_ptr _head;
+                u32         _count;
+                u32         _batchSize;
+            };
+
+            void refillBin(Bin& bin, u32 tableIndex);
+            void flushBin(Bin& bin, u32 count);
+
+            MemoryPool&         m_pool;
+            std::vector<Bin>    m_bins;
         };
 
         static constexpr u64 k_mixSizePageSize = 65'536;
+        static constexpr u64 k_countPagesPerAllocation = 16; //pool size is k_countPagesPerAllocation * page size
+        static constexpr u64 k_cacheLineSize = 64; //aligment of the cache line tables, their blocks never share a line
+
+        /*
+        * Layout of the small table pools
+        * Blocks: every block has a full header and lives in the used/free lists of the pool
+        * Slab: a block has only the owner pool pointer, occupancy is tracked in the pool bitmap
+        * AlignedSlab: blocks have no header, pools are aligned to the pool size and found by masking the address.
+        *   Medium pools and large allocations are aligned the same way, the pool size must be a power of two
+        */
+        enum class SmallTableLayout : u32
+        {
+            Blocks,
+            Slab,
+            AlignedSlab,
+        };
 
         /*
         * MemoryPool constuctor
         * param pageSize : page size (best size 65KB, but no more)
         * param allocator: allocator
         * param user: user data
+        * param layout: layout of the small table pools
         */
-        explicit MemoryPool(u64 pageSize, MemoryAllocator* allocator = MemoryPool::getDefaultMemoryAllocator(), bool deleteUnusedPools = true, void* user = nullptr) noexcept;
+        explicit MemoryPool(u64 pageSize, MemoryAllocator* allocator = MemoryPool::getDefaultMemoryAllocator(), bool deleteUnusedPools = true, void* user = nullptr, SmallTableLayout layout = SmallTableLayout::Blocks) noexcept;
 
         /*
         * ~MemoryPool destuctor
@@ -60,37 +168,147 @@ namespace mem
 
         /*
         * Request free memory from pool
+        * Aligned requests are served from the small/medium tables while the aligned size fits a pool,
+        * k_cacheLineSize aligned requests have own size classes
         * param size: count bytes will be requested
-        * param aligment: aligment
+        * param aligment: aligment, power of two. 0 - alignof(std::max_align_t)
         */
         address_ptr allocMemory(u64 size, u32 aligment = 0);
 
         template<class T>
         T* allocElement()
         {
-            return reinterpret_cast<T*>(allocMemory(sizeof(T)));
+            //size class is resolved at compile time
+            constexpr u32 sizeClass = getSizeClassOf(sizeof(T), alignof(T));
+            if constexpr (sizeClass != k_invalidSizeClass)
+            {
+                return reinterpret_cast<T*>(allocFromSizeClass(sizeClass));
+            }
+            else
+            {
+                return reinterpret_cast<T*>(allocMemory(sizeof(T), alignof(T)));
+            }
         }
 
         template<class T>
         T* allocArray(u64 count)
         {
-            return reinterpret_cast<T*>(allocMemory(sizeof(T) * count));
+            return reinterpret_cast<T*>(allocMemory(sizeof(T) * count, alignof(T)));
         }
 
         /*
         * Return memory to pool
+        * Can be called from any thread, memory of a pool owned by other thread is queued to its remote list
+        * and returned by the owner on the next allocation
         * param address_ptr: address of memory
         */
         void freeMemory(address_ptr memory);
 
+        /*
+        * Return memory of a known size, pool memory owned by the current thread skips the large allocation checks
+        * param address_ptr: address of memory
+        * param size: requested size of the memory
+        */
+        void freeMemory(address_ptr memory, u64 size);
+
+        static constexpr u32 k_invalidSizeClass = ~0U;
+
+        /*
+        * Small table serves the size, resolve it once for fixed size requests (container nodes)
+        * param size: count bytes
+        * param aligment: aligment, power of two. 0 - alignof(std::max_align_t)
+        * return size class or k_invalidSizeClass if the size isn't served by a small table
+        */
+        u32 getSizeClass(u64 size, u32 aligment = 0) const;
+
+        /*
+        * getSizeClass for sizes known at compile time, the same result
+        */
+        static constexpr u32 getSizeClassOf(u64 size, u32 aligment = 0)
+        {
+            if (aligment == k_cacheLineSize)
+            {
+                for (u32 index = 0; index < k_cacheLineTableSizes.size(); ++index)
+                {
+                    if (size <= k_cacheLineTableSizes[index])
+                    {
+                        return static_cast<u32>(k_smallBlockTableSizes.size()) + index;
+                    }
+                }
+                return k_invalidSizeClass;
+            }
+
+            constexpr u64 defaultAligment = alignof(std::max_align_t);
+            if (aligment > defaultAligment)
+            {
+                return k_invalidSizeClass;
+            }
+
+            u64 aligmentedSize = (size + defaultAligment - 1) & ~(defaultAligment - 1);
+            for (u32 index = 0; index < k_smallBlockTableSizes.size(); ++index)
+            {
+                if (aligmentedSize <= k_smallBlockTableSizes[index])
+                {
+                    return index;
+                }
+            }
+            return k_invalidSizeClass;
+        }
+
+        /*
+        * Request memory from a small table, skips the size dispatch of allocMemory
+        * param sizeClass: result of getSizeClass
+        */
+        address_ptr allocFromSizeClass(u32 sizeClass);
+
+        /*
+        * Resize memory, content is kept. The result has default aligment, large allocations must use default aligment
+        * Stays in place if the small block fits or the next medium block is free, large allocations are resized by the allocator
+        * param address_ptr: address of memory, nullptr - allocate
+        * param size: new count bytes
+        */
+        address_ptr reallocMemory(address_ptr memory, u64 size);
+
         /*
         * Prepare small table pools
         * call it if need more speed, but it creates a log of empty pools
         */
         void preAllocatePools();
 
+        /*
+        * Create a sub-heap, it shares the allocator, the page size, the layout and the size classes of this MemoryPool
+        * and takes pool spans from it. The heap owns its pools and is owned by the thread that creates it.
+        * Spans are supplied from any thread, this MemoryPool must outlive its heaps
+        */
+        MemoryPool* createHeap();
+
+        /*
+        * Return all memory of a heap to this MemoryPool and delete it, live blocks are dropped
+        * Time is proportional to the count of the heap pools and large allocations, not blocks
+        * param heap: heap created by this MemoryPool
+        */
+        void destroyHeap(MemoryPool* heap);
+
+        /*
+        * Reserve one range from the allocator, all pool spans are carved from it
+        * Pools are found by an index of the region instead of the block header, owns() is O(1) and freed pointers are validated.
+        * Must be called before the first allocation, the pool size must be power of two and the region big enough for all pools.
+        * Spans of released pools stay in the region and are reused, their pages are returned by MemoryAllocator::purge.
+        * If the allocator can't purge, the pages stay committed and are still counted by the footprint
+        * param size: size of the region, rounded up to the pool size
+        */
+        bool reserveRegion(u64 size);
+
+        /*
+        * Check the memory is allocated by this MemoryPool, requires the reserved region
+        * Pool memory is checked by the region index, large allocations by a hash set. Called by the owner thread
+        * param address_ptr: address of memory, any value
+        */
+        bool owns(address_ptr memory) const;
+
         /*
         * Reset pools, Return all requested allocation
+        * Constant time per table, pools are moved to the stale lists and reset when they are taken again
         */
         void reset();
 
@@ -106,8 +324,82 @@ namespace mem
 
         void collectStatistic();
 
+        /*
+        * Fragmentation of a medium table pool
+        * requested: bytes requested by live blocks, reserved: bytes taken by them with headers and slack
+        */
+        struct PoolFragmentation
+        {
+            u64 _requestedSize;
+            u64 _reservedSize;
+            u64 _poolSize;
+        };
+
+        std::vector<PoolFragmentation> getMediumFragmentation();
+
+        static constexpr u64 k_defaultLargeCacheLimit = 0;
+        static constexpr u64 k_defaultLargeCacheDecay = 1'000;
+
+        /*
+        * Freed large allocations are kept in the pool and reused by requests of a similar size (up to twice smaller)
+        * Max size of cached allocations in bytes, 0 - disable cache. Disabled by default: the cache decays only on
+        * large allocations and frees, a pool that stops using them keeps the cached memory until trim() or purgeLargeCache()
+        */
+        void setLargeCacheLimit(u64 size);
+        u64 getLargeCacheLimit() const;
+
+        /*
+        * Time in milliseconds a cached large allocation is kept before it's returned to the allocator
+        */
+        void setLargeCacheDecay(u64 milliseconds);
+        u64 getLargeCacheDecay() const;
+
+        /*
+        * Return all cached large allocations to the allocator
+        */
+        void purgeLargeCache();
+
+        struct LargeCacheStatistic
+        {
+            u64 _hits;
+            u64 _misses;
+            u64 _releases; //decayed or evicted by the limit
+            u64 _cachedSize;
+        };
+
+        LargeCacheStatistic getLargeCacheStatistic() const;
+
+        /*
+        * Memory taken by the pool: pools, large allocations, cached large allocations and spans kept for the heaps
+        */
+        u64 getFootprint() const;
+
+        /*
+        * Release retained memory down to the target footprint, live blocks are not touched
+        * Cached large allocations go first (the oldest first), then pools left by reset, empty pools and spans kept for the heaps.
+        * Released memory goes to the allocator, not to the page cache
+        * param targetSize: footprint to reach
+        * return count of released bytes
+        */
+        u64 trim(u64 targetSize);
+
+        typedef void(*BudgetCallback)(MemoryPool* pool, u64 footprint, u64 budget, void* user);
+
+        /*
+        * Soft limit of the footprint, checked when the pool takes new memory from the allocator
+        * Crossing it trims the pool to the budget, the callback is called once per crossing if the pool is still over.
+        * The callback is called inside an allocation and must not use the pool
+        * param budget: limit in bytes, 0 - no limit
+        * param callback: called when the budget is crossed
+        * param user: user data of the callback
+        */
+        void setMemoryBudget(u64 budget, BudgetCallback callback = nullptr, void* user = nullptr);
+        u64 getMemoryBudget() const;
+
     private:
 
+        friend ConcurrentMemoryPool;
+
         MemoryAllocator*    m_allocator;
         void*               m_userData;
 
@@ -230,6 +522,24 @@ namespace mem
                 }
             }
 
+            /*
+            * Move all nodes of other list to the end
+            */
+            void splice(List<T>& other)
+            {
+                if (other.empty())
+                {
+                    return;
+                }
+
+                link(_end._prev, other.begin());
+                link(other._end._prev, &_end);
+#if DEBUG_MEMORY
+                _size += other._size;
+#endif
+                other.clear();
+            }
+
             T* erase(T* node)
             {
                 link(node->_prev, node->_next);
@@ -258,24 +568,38 @@ namespace mem
         struct Block : Node<Block>
         {
             Block()
-                : _pool(nullptr)
-                , _size(0)
+                : _size(0)
+                , _pool(nullptr)
             {
             }
             
             Block(const Block&) = default;
 
             Block(Pool* pool, u64 size) noexcept
-                : _pool(pool)
-                , _size(size)
+                : _size(size)
+                , _pool(pool)
             {
             }
 
-            Pool*       _pool;
+            //large block placed after an aligment gap, the start of the allocation is stored right before the header
+            static const u64 k_alignedGapBit = 1;
+
+            u64 allocationSize() const
+            {
+                return _size & ~k_alignedGapBit;
+            }
+
+            address_ptr allocation()
+            {
+                return (_size & k_alignedGapBit) ? *reinterpret_cast<address_ptr*>(reinterpret_cast<u64>(this) - sizeof(address_ptr)) : this;
+            }
+
             u64         _size;
 #if DEBUG_MEMORY
             address_ptr _ptr;
+            u64         _padding; //keeps the user memory aligned
 #endif //DEBUG_MEMORY
+            Pool*       _pool; //must be last, the owner pool is read right before the user memory
             address_ptr ptr()
             {
 #if DEBUG_MEMORY
@@ -300,12 +624,24 @@ namespace mem
             }
         };
 
-        struct Pool : Node<Pool>
+        struct alignas(std::max_align_t) Pool : Node<Pool>
         {
             Pool()
                 : _table(nullptr)
                 , _blockSize(0)
+                , _requestedSize(0)
                 , _poolSize(0)
+                , _bitmap(nullptr)
+                , _slabs(0)
+                , _countBlocks(0)
+                , _countUsed(0)
+                , _searchIndex(0)
+                , _slotSize(0)
+                , _countCarved(0)
+                , _span(this)
+                , _spanSize(0)
+                , _owner()
+                , _remoteFree(nullptr)
             {
                 _used.clear();
                 _free.clear();
@@ -316,7 +652,19 @@ namespace mem
             Pool(PoolTable const* table, u64 blockSize, u64 poolSize) noexcept
                 : _table(table)
                 , _blockSize(blockSize)
+                , _requestedSize(0)
                 , _poolSize(poolSize)
+                , _bitmap(nullptr)
+                , _slabs(0)
+                , _countBlocks(0)
+                , _countUsed(0)
+                , _searchIndex(0)
+                , _slotSize(0)
+                , _countCarved(0)
+                , _span(this)
+                , _spanSize(poolSize)
+                , _owner(std::this_thread::get_id())
+                , _remoteFree(nullptr)
             {
                 _used.clear();
                 _free.clear();
@@ -334,24 +682,82 @@ namespace mem
 #endif
             }
 
-            void reset()
+            bool isSlab() const
+            {
+                return _bitmap != nullptr;
+            }
+
+            bool isEmpty() const
             {
-                Block* block = _used.begin();
-                while (block != _used.end())
+                return _countUsed == 0;
+            }
+
+            bool isFull() const
+            {
+                return isSlab() ? _countUsed == _countBlocks : _free.empty() && _countCarved == _countBlocks;
+            }
+
+            u64 slotSize() const
+            {
+                return isSlab() ? _slotSize : _blockSize + sizeof(Block);
+            }
+
+            void resetBitmap()
+            {
+                u32 countWords = (_countBlocks + 63) >> 6;
+                for (u32 i = 0; i < countWords; ++i)
+                {
+                    _bitmap[i] = ~0ULL;
+                }
+
+                if (u32 tail = _countBlocks & 63; tail > 0)
                 {
-                    Block* newBlock = block->_next;
-                    _free.insert(block);
+                    _bitmap[countWords - 1] = (1ULL << tail) - 1;
+                }
+                _countUsed = 0;
+                _searchIndex = 0;
+            }
 
-                    block = newBlock;
+            void reset()
+            {
+                if (isSlab())
+                {
+                    resetBitmap();
+                    return;
                 }
+
+                //fixed blocks are carved again, medium blocks are rebuilt by the table
+                _countUsed = 0;
                 _used.clear();
+                _free.clear();
+                _countCarved = 0;
             }
 
-            PoolTable const*    _table;
-            u64                 _blockSize;
-            const u64           _poolSize;
-            List<Block>         _used;
-            List<Block>         _free;
+            PoolTable const*            _table;
+            u64                         _blockSize;
+            u64                         _requestedSize; //medium pools, bytes requested by live blocks
+            const u64                   _poolSize;
+            List<Block>                 _used;
+            List<Block>                 _free;
+
+            //slab layout, a set bit is a free slot
+            u64*                        _bitmap;
+            u64                         _slabs;
+            u32                         _countBlocks;
+            u32                         _countUsed; //live blocks, all layouts
+            u32                         _searchIndex; //words before are full
+            u32                         _slotSize;
+
+            //fixed blocks layout, slots after the carved ones were never handed out
+            u32                         _countCarved;
+
+            //allocated memory, differs from the pool address if the span was over allocated to align the pool
+            address_ptr                 _span;
+            u64                         _spanSize;
+
+            //blocks freed by other threads, drained by the owner
+            const std::thread::id       _owner;
+            std::atomic<address_ptr>    _remoteFree;
         };
 
         struct PoolTable
@@ -360,64 +766,324 @@ namespace mem
             {
                 Default = 0,
                 SmallTable,
+                SlabTable,
+                AlignedSlabTable,
+                CacheLineTable, //slab table, slots are aligned to the cache line
             };
 
             PoolTable() noexcept
-                : _size(0)
+                : _memoryPool(nullptr)
+                , _size(0)
                 , _type(Type::Default)
+                , _countEmptyPools(0)
+                , _remoteFreeCount(0)
             {
             }
 
             PoolTable(const PoolTable& table)
-                : _size(0)
+                : _memoryPool(nullptr)
+                , _size(0)
                 , _type(Type::Default)
+                , _countEmptyPools(0)
+                , _remoteFreeCount(0)
             {
                 //wrong runtime logic, but need for compile
                 assert(false);
             }
 
             explicit PoolTable(u16 size, PoolTable::Type type) noexcept
-                : _size(size)
+                : _memoryPool(nullptr)
+                , _size(size)
                 , _type(Type::Default)
+                , _countEmptyPools(0)
+                , _remoteFreeCount(0)
             {
             }
 
-            List<Pool>  _activePools;
-            List<Pool>  _fullPools;
-            u64         _size;
-            Type        _type;
+            List<Pool>          _activePools;
+            List<Pool>          _fullPools;
+            List<Pool>          _stalePools; //pools before the last reset, taken before allocating new
+            MemoryPool*         _memoryPool;
+            u64                 _size;
+            Type                _type;
+            u32                 _countEmptyPools; //empty pools kept in the active list
+
+            //count of blocks waiting in the remote lists of the table pools
+            std::atomic<u64>    _remoteFreeCount;
+        };
+
+        /*
+        * Header of a medium block, blocks of a pool follow each other without gaps
+        * A free block keeps the index links after the header and its size in the last bytes (boundary tag),
+        * so a freed block finds both physical neighbours in constant time
+        */
+        struct MediumBlock
+        {
+            static constexpr u32 k_freeBit = 1;
+            static constexpr u32 k_prevFreeBit = 2;
+            static constexpr u32 k_flagsMask = k_freeBit | k_prevFreeBit;
+
+            MediumBlock() noexcept
+                : _size(0)
+                , _requestedSize(0)
+                , _pool(nullptr)
+            {
+            }
+
+            MediumBlock(Pool* pool, u64 size) noexcept
+                : _size(static_cast<u32>(size))
+                , _requestedSize(0)
+                , _pool(pool)
+            {
+            }
+
+            u64 size() const
+            {
+                return _size & ~k_flagsMask;
+            }
+
+            bool isFree() const
+            {
+                return _size & k_freeBit;
+            }
+
+            bool isPrevFree() const
+            {
+                return _size & k_prevFreeBit;
+            }
+
+            address_ptr ptr()
+            {
+                return reinterpret_cast<address_ptr>(reinterpret_cast<u64>(this) + sizeof(MediumBlock));
+            }
+
+            MediumBlock* next()
+            {
+                return reinterpret_cast<MediumBlock*>(reinterpret_cast<u64>(this) + size());
+            }
+
+            MediumBlock* prev()
+            {
+                assert(isPrevFree());
+                u64 prevSize = *reinterpret_cast<u64*>(reinterpret_cast<u64>(this) - sizeof(u64));
+                return reinterpret_cast<MediumBlock*>(reinterpret_cast<u64>(this) - prevSize);
+            }
+
+            u32     _size;          //size with header, low bits are flags
+            u32     _requestedSize; //bytes requested by user, used blocks only
+            Pool*   _pool;          //must be last, the owner pool is read right before the user memory
+        };
+
+        struct FreeMediumBlock : MediumBlock
+        {
+            FreeMediumBlock() noexcept
+                : _prev(nullptr)
+                , _next(nullptr)
+            {
+            }
+
+            FreeMediumBlock* _prev;
+            FreeMediumBlock* _next;
         };
 
-        static const u64 k_countPagesPerAllocation = 16;
+        /*
+        * Two level segregated fit index of the free medium blocks (TLSF)
+        * First level is the power of two of the size, second level splits it to k_secondLevels ranges
+        * Every range has a free list, the bitmaps point to non empty lists
+        */
+        struct FreeBlockIndex
+        {
+            static constexpr u32 k_firstLevels = 32;
+            static constexpr u32 k_secondLevelsLog2 = 4;
+            static constexpr u32 k_secondLevels = 1 << k_secondLevelsLog2;
+
+            FreeBlockIndex() noexcept;
+
+            void                insert(FreeMediumBlock* block);
+            void                erase(FreeMediumBlock* block);
+            FreeMediumBlock*    find(u64 size);
+            void                clear();
+
+            static void mapping(u64 size, u32& firstLevel, u32& secondLevel);
+
+            u32                                                                     _firstLevelMap;
+            std::array<u32, k_firstLevels>                                          _secondLevelMap;
+            std::array<std::array<List<FreeMediumBlock>, k_secondLevels>, k_firstLevels> _lists;
+        };
+
+        static const u32 k_countEmptyPoolsPerTable = 2; //empty pools kept by a table before releasing
 
         static const u64 k_maxSizeSmallTableAllocation = 32'768;
-        std::array<u16, (k_maxSizeSmallTableAllocation >> 2)> m_smallTableIndex;
-        std::vector<PoolTable>  m_smallPoolTables;
+        static const u64 k_minSizeMediumSplit = 256; //smaller remainder stays in the allocated block
+        static const u64 k_alignedHeaderSize = 16; //[offset marker][owner pool] right before an aligned pointer inside a block
+        static const u64 k_maxSizeCacheLineAllocation = 4'096;
+        static const u32 k_invalidTableIndex = ~0U;
+
+        static constexpr std::array<u16, 45> k_smallBlockTableSizes =
+        {
+            16, 32, 48, 64, 80, 96, 112, 128,
+            160, 192, 224, 256, 288, 320, 384, 448,
+            512, 576, 640, 704, 768, 896, 1024, 1168,
+            1360, 1632, 2048, 2336, 2720, 3264, 4096, 4368,
+            4672, 5040, 5456, 5952, 6544, 7280, 8192, 9360,
+            10912, 13104, 16384, 21840, 32768
+        };
+
+        static constexpr std::array<u16, 18> k_cacheLineTableSizes =
+        {
+            64, 128, 192, 256, 320, 384, 448, 512,
+            640, 768, 896, 1024, 1280, 1536, 2048, 2560,
+            3072, 4096
+        };
+        //size to table index, the same for every MemoryPool
+        struct SizeClassIndex
+        {
+            SizeClassIndex() noexcept;
+
+            std::array<u16, (k_maxSizeSmallTableAllocation >> 2)> _smallTableIndex;
+            std::array<u16, (k_maxSizeCacheLineAllocation / k_cacheLineSize)> _cacheLineTableIndex;
+        };
+
+        static const SizeClassIndex& getSizeClassIndex();
+
+        const SizeClassIndex&   m_sizeClassIndex;
+        std::vector<PoolTable>  m_smallPoolTables; //cache line tables are after the default ones
 
         PoolTable               m_poolTable;
+        FreeBlockIndex          m_freeBlockIndex;
 
         const u64               k_pageSize;
         const u64               k_maxSizePoolAllocation;
+        const u64               k_poolSize;
 
         List<Block>             m_largeAllocations;
 
+        //freed large allocations, bucket is log2 of the size, entries are ordered by the release time
+        struct LargeCacheEntry : Node<LargeCacheEntry>
+        {
+            u64         _size; //allocation size from the entry address
+            address_ptr _span;
+            u64         _spanSize;
+            u64         _releaseTime;
+        };
+
+        static constexpr u32 k_countLargeCacheBuckets = 64;
+        std::array<List<LargeCacheEntry>, k_countLargeCacheBuckets> m_largeCache;
+        u64                     m_largeCacheLimit;
+        u64                     m_largeCacheDecay;
+        u64                     m_largeCachedSize;
+        u64                     m_largeCacheNextDecay;
+        LargeCacheStatistic     m_largeCacheStatistic;
+
+        //large allocations are owned by the thread created the MemoryPool
+        const std::thread::id       m_ownerThread;
+        std::atomic<address_ptr>    m_remoteLargeFree;
+
+        //reserved region, a slot of the pool size per pool
+        address_ptr                     m_region;
+        u64                             m_regionSize;
+        address_ptr                     m_regionSpan;
+        u64                             m_regionSpanSize;
+        u32                             m_regionShift;
+        u32                             m_regionCarvedSlots; //slots after were never used
+        std::vector<Pool*>              m_regionPools; //nullptr - free slot
+        std::vector<u32>                m_regionFreeSlots; //pages are purged
+        std::vector<u32>                m_regionRetainedSlots; //the allocator can't purge, pages stay committed and counted by the footprint
+        std::unordered_set<address_ptr> m_regionLargeAllocations; //user pointers of the large allocations
+
+        //sub-heaps take pool spans from the parent, spans of destroyed heaps are kept for the next ones
+        struct HeapSpan
+        {
+            address_ptr _memory;
+            address_ptr _span;
+            u64         _spanSize;
+        };
+
+        static constexpr u64 k_heapSupplyLimit = 64 * 1024 * 1024;
+
+        MemoryPool*             m_parent;
+        std::atomic<u32>        m_countHeaps;
+        std::vector<HeapSpan>   m_heapSupply;
+        std::atomic<u64>        m_heapSupplySize;
+        std::mutex              m_heapMutex;
+
+        //footprint and budget
+        u64                     m_poolsSize; //spans of the pools
+        u64                     m_largeSize; //live large allocations
+        u64                     m_memoryBudget;
+        BudgetCallback          m_budgetCallback;
+        void*                   m_budgetUser;
+        bool                    m_overBudget;
+
         static MemoryAllocator* s_defaultMemoryAllocator;
 
 
+        Pool*   allocateSmallPool(PoolTable* table);
         Pool*   allocateFixedBlocksPool(PoolTable* table, u32 align);
+        Pool*   allocateSlabPool(PoolTable* table, u32 align);
         Pool*   allocatePool(PoolTable* table, u32 align);
-        void    deallocatePool(Pool* pool);
+        void    deallocatePool(Pool* pool, bool toCache = true);
+        void    releasePool(PoolTable& table, Pool* pool, bool toCache);
+        Pool*   takeStalePool(PoolTable& table);
+        void    deallocatePools(List<Pool>& pools);
+        void    deallocateStalePools(PoolTable& table);
+        void    dropRemoteFree(PoolTable& table, Pool* pool);
 
-        Block* initBlock(address_ptr ptr, Pool* pool, u64 size);
-        void freeBlock(Block* block);
+        address_ptr allocatePoolSpan(u32 align, address_ptr& span, u64& spanSize);
+        address_ptr allocateAlignedSpan(u64 size, address_ptr& span, u64& spanSize);
 
-        Block* allocateFromSmallTables(u64 size);
-        Block* allocateFromTable(u64 size);
+        address_ptr allocateSpan(u64 size, u32 align);
+        void        deallocateSpan(address_ptr memory, u64 size);
 
-        void collectEmptyPools(List<Pool>& pools, std::vector<Pool*>& markedToDelete);
-        std::vector<Pool*> m_markedToDelete;
+        address_ptr allocateRegionSpan();
+        void        deallocateRegionSpan(Pool* pool);
+
+        address_ptr allocateAllocatorSpan(u32 align, address_ptr& span, u64& spanSize);
+        address_ptr acquireHeapSpan(u32 align, address_ptr& span, u64& spanSize);
+        void        releaseHeapSpan(address_ptr memory, address_ptr span, u64 spanSize);
+        void        releaseHeapPools();
+
+        Block* initBlock(address_ptr ptr, Pool* pool, u64 size);
+        void freeMemoryLocal(address_ptr memory);
+        void freePoolMemory(Pool* pool, address_ptr memory);
+        void freeBlock(Block* block);
+        void freeSlabBlock(Pool* pool, address_ptr memory);
+        void freeLargeBlock(Block* block);
+
+        address_ptr acquireLargeCache(u64& size, address_ptr& span, u64& spanSize);
+        bool releaseLargeCache(address_ptr memory, u64 size, address_ptr span, u64 spanSize);
+        void evictLargeCache(u64 limit);
+        void decayLargeCache(u64 time);
+        void releaseLargeCacheEntry(LargeCacheEntry* entry);
+        void onPoolEmpty(PoolTable& table, Pool* pool);
+        void checkMemoryBudget(u64 size);
+
+        static void pushRemoteFree(std::atomic<address_ptr>& list, address_ptr memory);
+        void drainRemoteFree(PoolTable& table);
+        void drainRemoteLargeFree();
+
+        u32 getSmallTableIndex(u64 size, u32 aligment) const;
+        address_ptr allocateFromSmallTable(u32 tableIndex);
+        address_ptr allocateFromSlab(Pool* pool);
+        MediumBlock* allocateFromTable(u64 size);
+        bool resizeMediumBlock(MediumBlock* block, u64 size);
+        Block* resizeLargeBlock(Block* block, u64 size);
+        u64 getAllocationSize(address_ptr memory) const;
+        void freeMediumBlock(MediumBlock* block);
+        void insertFreeMediumBlock(address_ptr memory, Pool* pool, u64 size);
+
+        u64 getAlignedAllocationSize(u64 size, u32 aligment) const;
+        address_ptr alignBlockMemory(address_ptr memory, u32 aligment) const;
+        address_ptr getBlockMemory(Pool* pool, address_ptr memory) const;
+
+        Pool* getPool(address_ptr memory) const;
+        MemoryPool* getMemoryPool(address_ptr memory) const;
+        bool isLargeAllocation(u64 size, u32 aligment) const;
 
         const bool k_deleteUnusedPools;
+        const SmallTableLayout k_smallTableLayout;
+
+        std::mutex m_mutex;
 
 #if ENABLE_STATISTIC
         struct Statistic
@@ -515,10 +1181,211 @@ namespace mem
     public:
 
         explicit DefaultMemoryAllocator() noexcept = default;
-        ~DefaultMemoryAllocator() = default;
+        ~DefaultMemoryAllocator();
 
         address_ptr allocate(u64 size, u32 aligment = 0, void* user = nullptr) override;
         void        deallocate(address_ptr memory, u64 size = 0, void* user = nullptr) override;
+        address_ptr reallocate(address_ptr memory, u64 size, u64 newSize, void* user = nullptr) override;
+    };
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#if defined(__linux__)
+    /*
+    * class LinuxVirtualMemoryAllocator. Allocator over one reserved address range
+    * The range is reserved once and pages are committed by the first touch. Freed ranges keep their addresses,
+    * the pages are returned to the OS with madvise, so a reused range costs a page fault instead of mmap/munmap.
+    * Requests over the reserved range are mapped separately. Thread safe, the deallocated size must be passed
+    * With huge pages every request is rounded to k_hugePageSize and mapped with MAP_HUGETLB while the system has
+    * free huge pages, otherwise it is taken from the reserve, which is advised with MADV_HUGEPAGE
+    */
+    class LinuxVirtualMemoryAllocator : public MemoryPool::MemoryAllocator
+    {
+    public:
+
+        LinuxVirtualMemoryAllocator(const LinuxVirtualMemoryAllocator&) = delete;
+        LinuxVirtualMemoryAllocator& operator=(const LinuxVirtualMemoryAllocator&) = delete;
+
+        enum class PurgeMode : u32
+        {
+            DontNeed, //MADV_DONTNEED, pages are released at once
+            Free, //MADV_FREE, pages are released lazily under memory pressure. DontNeed if not supported by the kernel
+        };
+
+        static constexpr u64 k_defaultReserveSize = 64ULL * 1024 * 1024 * 1024;
+        static constexpr u64 k_hugePageSize = 2 * 1024 * 1024;
+
+        /*
+        * LinuxVirtualMemoryAllocator constuctor
+        * param reserveSize: size of the reserved address range, physical memory is not taken
+        * param mode: how the pages of freed ranges are returned
+        * param hugePages: back the memory with huge pages
+        */
+        explicit LinuxVirtualMemoryAllocator(u64 reserveSize = k_defaultReserveSize, PurgeMode mode = PurgeMode::Free, bool hugePages = false) noexcept;
+        ~LinuxVirtualMemoryAllocator();
+
+        address_ptr allocate(u64 size, u32 aligment = 0, void* user = nullptr) override;
+        void        deallocate(address_ptr memory, u64 size = 0, void* user = nullptr) override;
+        address_ptr reallocate(address_ptr memory, u64 size, u64 newSize, void* user = nullptr) override;
+        bool        purge(address_ptr memory, u64 size, void* user = nullptr) override;
+
+        bool owns(address_ptr memory) const;
+
+        /*
+        * Page size for a MemoryPool on this allocator, the pool size is rounded up to fill whole huge pages
+        * param pageSize: requested page size of the MemoryPool
+        */
+        u64 getMemoryPoolPageSize(u64 pageSize) const;
+
+        struct Statistic
+        {
+            u64 _reservedSize;
+            u64 _usedSize; //allocated from the reserved range
+            u64 _purgedSize; //returned by madvise
+            u64 _externalSize; //mapped over the reserved range
+            u64 _hugeTlbSize; //part of the external size mapped with MAP_HUGETLB
+        };
+
+        Statistic getStatistic() const;
+
+    private:
+
+        u64 takeRange(u64 size, u64 aligment);
+        void insertRange(u64 address, u64 size);
+        void eraseRange(u64 address, u64 size);
+        void releaseRange(u64 address, u64 size);
+        void purgeRange(u64 address, u64 size);
+
+        address_ptr mapExternal(u64 size, u64 aligment);
+
+        address_ptr         m_reserve;
+        u64                 m_reserveSize;
+        const u64           m_pageSize;
+        PurgeMode           m_mode;
+        const bool          m_hugePages;
+
+        std::map<u64, u64>  m_hugeTlbMappings; //address - size
+        std::atomic<bool>   m_hugeTlbAvailable; //false after MAP_HUGETLB failed, until a huge page is unmapped. Read without the lock
+
+        //free ranges of the reserve, neighbours are merged
+        std::map<u64, u64>      m_freeRanges; //address - size
+        std::multimap<u64, u64> m_freeRangesBySize; //size - address, best fit
+
+        Statistic           m_statistic;
+        mutable std::mutex  m_mutex;
+    };
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////
+#endif //__linux__
+
+    /*
+    * class PageCache. Process wide cache of pool spans
+    * Spans released by any MemoryPool are kept here (up to retention limit) and reused by any other MemoryPool
+    * that requests a span of the same size from the same allocator. Lock free, the allocator must be thread safe
+    * Disabled by default, retained spans outlive the pools and keep memory deleteUnusedPools would release
+    */
+    class PageCache final
+    {
+    public:
+
+        PageCache(const PageCache&) = delete;
+        PageCache& operator=(const PageCache&) = delete;
+
+        static constexpr u64 k_defaultRetentionLimit = 0;
+
+        static PageCache& getInstance();
+
+        /*
+        * Request span from cache
+        * return nullptr if there is no span of that size from that allocator
+        * param aligment: required aligment of the span, 0 - any
+        */
+        address_ptr acquireSpan(MemoryPool::MemoryAllocator* allocator, u64 size, void* user = nullptr, u32 aligment = 0);
+
+        /*
+        * Put span to cache
+        * return false if the retention limit is reached, span must be deallocated by caller
+        */
+        bool releaseSpan(MemoryPool::MemoryAllocator* allocator, address_ptr memory, u64 size, void* user = nullptr);
+
+        /*
+        * Max size of cached spans in bytes, 0 - disable cache
+        */
+        void setRetentionLimit(u64 size);
+        u64 getRetentionLimit() const;
+
+        /*
+        * Return all cached spans to allocators
+        */
+        void clear();
+
+        /*
+        * Return cached spans of one allocator, must be called before the allocator is destroyed
+        */
+        void clear(MemoryPool::MemoryAllocator* allocator);
+
+        /*
+        * Remove cached spans of one allocator without returning them, called by ~MemoryAllocator
+        * Spans found here are leaked, the derived allocator must call clear(this) in its destructor
+        */
+        void forget(MemoryPool::MemoryAllocator* allocator);
+
+        struct Statistic
+        {
+            u64 _hits;
+            u64 _misses;
+            u64 _releases;
+            u64 _overflows;
+            u64 _cachedSize;
+        };
+
+        Statistic getStatistic() const;
+        void collectStatistic();
+
+    private:
+
+        PageCache() noexcept;
+        ~PageCache();
+
+        struct SpanHeader
+        {
+            MemoryPool::MemoryAllocator*    _allocator;
+            void*                           _user;
+            u64                             _size;
+        };
+
+        /*
+        * Slot of a cached span, the allocator and the key are written before the span is published
+        * The key is a hash of the span header, lookups skip other spans without taking them
+        */
+        struct Slot
+        {
+            std::atomic<address_ptr>                    _span; //nullptr - empty, k_reservedSlot - being filled
+            std::atomic<MemoryPool::MemoryAllocator*>   _allocator;
+            std::atomic<u64>                            _key;
+        };
+
+        static u64 getSpanKey(MemoryPool::MemoryAllocator* allocator, u64 size, void* user);
+        static bool isCachedSpan(address_ptr memory);
+
+        Slot* getBucket(u64 key);
+        bool pushSpan(address_ptr memory);
+        address_ptr takeSpan(Slot& slot, MemoryPool::MemoryAllocator* allocator);
+        void deallocateSpan(address_ptr memory);
+
+        //spans of one allocator and size share a bucket
+        static const u32 k_countBuckets = 4;
+        static const u32 k_countSlotsPerBucket = 128;
+        static const u64 k_reservedSlot = 1;
+        std::array<Slot, k_countBuckets * k_countSlotsPerBucket> m_slots;
+
+        std::atomic<u64>    m_retentionLimit;
+        std::atomic<u64>    m_cachedSize;
+
+        std::atomic<u64>    m_hits;
+        std::atomic<u64>    m_misses;
+        std::atomic<u64>    m_releases;
+        std::atomic<u64>    m_overflows;
     };
 
     /////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,249 @@
+#include "MemoryPressureMonitor.h"
+
+#include <fstream>
+#include <cstdlib>
+#include <chrono>
+
+namespace mem
+{
+    static bool readValue(const std::string& path, u64& value)
+    {
+        std::ifstream file(path);
+        std::string token;
+        if (!(file >> token))
+        {
+            return false;
+        }
+
+        //memory.high is "max" without a limit
+        if (token == "max")
+        {
+            value = ~0ULL;
+            return true;
+        }
+        value = std::strtoull(token.c_str(), nullptr, 10);
+        return true;
+    }
+
+    static bool readPressure(const std::string& path, double& some, double& full)
+    {
+        //some avg10=0.00 avg60=0.00 avg300=0.00 total=0
+        //full avg10=0.00 avg60=0.00 avg300=0.00 total=0
+        std::ifstream file(path);
+        std::string kind;
+        std::string avg10;
+        std::string line;
+        bool found = false;
+        while (file >> kind >> avg10 && std::getline(file, line))
+        {
+            if (avg10.compare(0, 6, "avg10=") != 0)
+            {
+                continue;
+            }
+
+            double value = std::strtod(avg10.c_str() + 6, nullptr);
+            if (kind == "some")
+            {
+                some = value;
+                found = true;
+            }
+            else if (kind == "full")
+            {
+                full = value;
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    static std::string getProcessCgroupPath()
+    {
+        //cgroup v2 entry is "0::/path"
+        std::ifstream file("/proc/self/cgroup");
+        std::string line;
+        while (std::getline(file, line))
+        {
+            if (line.compare(0, 3, "0::") == 0)
+            {
+                return "/sys/fs/cgroup" + line.substr(3);
+            }
+        }
+        return "/sys/fs/cgroup";
+    }
+
+    MemoryPressureMonitor::MemoryPressureMonitor(MemoryPool& pool) noexcept
+        : MemoryPressureMonitor(pool, Config())
+    {
+    }
+
+    MemoryPressureMonitor::MemoryPressureMonitor(MemoryPool& pool, const Config& config) noexcept
+        : m_pool(pool)
+        , m_config(config)
+
+        , m_pressure(static_cast<u32>(Pressure::None))
+        , m_excessSize(0)
+        , m_pending(false)
+
+        , m_countSamples(0)
+        , m_countModerate(0)
+        , m_countCritical(0)
+        , m_countTrims(0)
+        , m_releasedSize(0)
+
+        , m_running(false)
+    {
+        std::string cgroupPath = m_config._cgroupPath.empty() ? getProcessCgroupPath() : m_config._cgroupPath;
+        if (cgroupPath.back() != '/')
+        {
+            cgroupPath += '/';
+        }
+        m_memoryCurrentPath = cgroupPath + "memory.current";
+        m_memoryHighPath = cgroupPath + "memory.high";
+    }
+
+    MemoryPressureMonitor::~MemoryPressureMonitor()
+    {
+        MemoryPressureMonitor::stop();
+    }
+
+    void MemoryPressureMonitor::start()
+    {
+        std::lock_guard<std::mutex> lock(m_threadMutex);
+        if (m_running)
+        {
+            return;
+        }
+
+        m_running = true;
+        m_thread = std::thread(&MemoryPressureMonitor::run, this);
+    }
+
+    void MemoryPressureMonitor::stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_threadMutex);
+            if (!m_running)
+            {
+                return;
+            }
+            m_running = false;
+        }
+        m_threadCondition.notify_all();
+        m_thread.join();
+    }
+
+    void MemoryPressureMonitor::run()
+    {
+        std::unique_lock<std::mutex> lock(m_threadMutex);
+        while (m_running)
+        {
+            lock.unlock();
+            MemoryPressureMonitor::sample();
+            lock.lock();
+
+            m_threadCondition.wait_for(lock, std::chrono::milliseconds(m_config._pollInterval), [this]() -> bool { return !m_running; });
+        }
+    }
+
+    MemoryPressureMonitor::Pressure MemoryPressureMonitor::sample()
+    {
+        m_countSamples.fetch_add(1, std::memory_order_relaxed);
+
+        Pressure pressure = Pressure::None;
+        u64 excessSize = 0;
+
+        u64 current = 0;
+        u64 high = 0;
+        if (readValue(m_memoryCurrentPath, current) && readValue(m_memoryHighPath, high) && high != ~0ULL)
+        {
+            u64 watermark = static_cast<u64>(static_cast<double>(high) * m_config._highWatermark);
+            if (current >= high)
+            {
+                pressure = Pressure::Critical;
+            }
+            else if (current >= watermark)
+            {
+                pressure = Pressure::Moderate;
+            }
+            excessSize = (current > watermark) ? current - watermark : 0;
+        }
+
+        double some = 0.0;
+        double full = 0.0;
+        if (readPressure(m_config._pressurePath, some, full))
+        {
+            if (full >= m_config._fullThreshold)
+            {
+                pressure = Pressure::Critical;
+            }
+            else if (some >= m_config._someThreshold && pressure == Pressure::None)
+            {
+                pressure = Pressure::Moderate;
+            }
+        }
+
+        m_excessSize.store(excessSize, std::memory_order_relaxed);
+        m_pressure.store(static_cast<u32>(pressure), std::memory_order_relaxed);
+        if (pressure != Pressure::None)
+        {
+            m_pending.store(true, std::memory_order_release);
+        }
+
+        return pressure;
+    }
+
+    u64 MemoryPressureMonitor::update()
+    {
+        if (!m_pending.load(std::memory_order_acquire))
+        {
+            return 0;
+        }
+        m_pending.store(false, std::memory_order_relaxed);
+
+        Pressure pressure = static_cast<Pressure>(m_pressure.load(std::memory_order_relaxed));
+        u64 footprint = m_pool.getFootprint();
+        u64 targetSize = 0;
+        if (pressure == Pressure::Moderate)
+        {
+            //give back the excess over the watermark, half of the pool if the cgroup limit is unknown
+            u64 excessSize = m_excessSize.load(std::memory_order_relaxed);
+            u64 releaseSize = (excessSize > 0) ? excessSize : footprint / 2;
+            targetSize = footprint - std::min(footprint, releaseSize);
+            m_countModerate.fetch_add(1, std::memory_order_relaxed);
+        }
+        else if (pressure == Pressure::Critical)
+        {
+            m_countCritical.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            return 0;
+        }
+
+        u64 releasedSize = m_pool.trim(targetSize);
+        if (releasedSize > 0)
+        {
+            m_countTrims.fetch_add(1, std::memory_order_relaxed);
+            m_releasedSize.fetch_add(releasedSize, std::memory_order_relaxed);
+        }
+
+        return releasedSize;
+    }
+
+    MemoryPressureMonitor::Pressure MemoryPressureMonitor::getPressure() const
+    {
+        return static_cast<Pressure>(m_pressure.load(std::memory_order_relaxed));
+    }
+
+    MemoryPressureMonitor::Statistic MemoryPressureMonitor::getStatistic() const
+    {
+        Statistic statistic;
+        statistic._countSamples = m_countSamples.load(std::memory_order_relaxed);
+        statistic._countModerate = m_countModerate.load(std::memory_order_relaxed);
+        statistic._countCritical = m_countCritical.load(std::memory_order_relaxed);
+        statistic._countTrims = m_countTrims.load(std::memory_order_relaxed);
+        statistic._releasedSize = m_releasedSize.load(std::memory_order_relaxed);
+        return statistic;
+    }
+
+} //namespace mem
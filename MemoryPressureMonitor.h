@@ -0,0 +1,109 @@
+#pragma once
+
+#include "MemoryPool.h"
+
+#include <string>
+#include <thread>
+#include <condition_variable>
+
+namespace mem
+{
+    /*
+    * class MemoryPressureMonitor. Trims a MemoryPool when the system runs low on memory
+    * Reads cgroup v2 memory.current/memory.high and PSI /proc/pressure/memory, missing files give no signal.
+    * Files are read by sample() or by a background thread, the trim is applied by update() on the thread owns the pool,
+    * MemoryPool is not thread safe. update() is a single atomic load while there is no pressure
+    */
+    class MemoryPressureMonitor final
+    {
+    public:
+
+        MemoryPressureMonitor(const MemoryPressureMonitor&) = delete;
+        MemoryPressureMonitor& operator=(const MemoryPressureMonitor&) = delete;
+
+        enum class Pressure : u32
+        {
+            None,
+            Moderate,   //trim the share of the pool above the watermark
+            Critical    //trim everything the pool retains
+        };
+
+        struct Config
+        {
+            std::string _cgroupPath;                            //cgroup v2 directory, empty - cgroup of the process
+            std::string _pressurePath = "/proc/pressure/memory";
+            u32         _pollInterval = 100;                    //ms, background thread
+            double      _highWatermark = 0.9;                   //moderate from this share of memory.high
+            double      _someThreshold = 10.0;                  //moderate from this PSI "some avg10", %
+            double      _fullThreshold = 5.0;                   //critical from this PSI "full avg10", %
+        };
+
+        struct Statistic
+        {
+            u64 _countSamples;
+            u64 _countModerate;
+            u64 _countCritical;
+            u64 _countTrims;
+            u64 _releasedSize;
+        };
+
+        /*
+        * MemoryPressureMonitor constuctor
+        * param pool: pool to trim, must outlive the monitor
+        * param config: paths and thresholds, default config if not set
+        */
+        explicit MemoryPressureMonitor(MemoryPool& pool) noexcept;
+        MemoryPressureMonitor(MemoryPool& pool, const Config& config) noexcept;
+
+        /*
+        * ~MemoryPressureMonitor destuctor, stops the background thread
+        */
+        ~MemoryPressureMonitor();
+
+        /*
+        * Start/stop the background thread calls sample() every poll interval
+        */
+        void start();
+        void stop();
+
+        /*
+        * Read the files once and publish the pressure for update(), any thread
+        * return current pressure
+        */
+        Pressure sample();
+
+        /*
+        * Trim the pool if the last sample found pressure, the thread owns the pool
+        * return count of released bytes
+        */
+        u64 update();
+
+        Pressure getPressure() const;
+        Statistic getStatistic() const;
+
+    private:
+
+        void run();
+
+        MemoryPool&                 m_pool;
+        Config                      m_config;
+        std::string                 m_memoryCurrentPath;
+        std::string                 m_memoryHighPath;
+
+        std::atomic<u32>            m_pressure;
+        std::atomic<u64>            m_excessSize;   //bytes above the watermark of memory.high, 0 - unknown
+        std::atomic<bool>           m_pending;
+
+        std::atomic<u64>            m_countSamples;
+        std::atomic<u64>            m_countModerate;
+        std::atomic<u64>            m_countCritical;
+        std::atomic<u64>            m_countTrims;
+        std::atomic<u64>            m_releasedSize;
+
+        std::thread                 m_thread;
+        std::mutex                  m_threadMutex;
+        std::condition_variable     m_threadCondition;
+        bool                        m_running;
+    };
+
+} //namespace mem
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "MemoryPool.h"
+
+#include <new>
+#include <utility>
+
+namespace mem
+{
+    /*
+    * class ObjectPool. Typed objects from a MemoryPool
+    * Size class of T is resolved at compile time, objects come straight from its small table without the size dispatch.
+    * Optional object caching: release() keeps up to cacheSize objects constructed and acquire() returns them as they were left,
+    * constructor/destructor runs only on a cache miss/overflow. Not thread safe
+    */
+    template<class T>
+    class ObjectPool final
+    {
+    public:
+
+        ObjectPool(const ObjectPool&) = delete;
+        ObjectPool& operator=(const ObjectPool&) = delete;
+
+        static constexpr u32 k_sizeClass = MemoryPool::getSizeClassOf(sizeof(T), alignof(T));
+
+        /*
+        * ObjectPool constuctor
+        * param pool: source of the memory, must outlive the object pool
+        * param cacheSize: count of constructed objects kept by release(), 0 - no caching
+        */
+        explicit ObjectPool(MemoryPool& pool, u32 cacheSize = 0) noexcept
+            : m_pool(pool)
+            , m_cache(cacheSize)
+            , m_countCached(0)
+        {
+        }
+
+        /*
+        * ~ObjectPool destuctor, destroys cached objects. Objects still in use must be destroyed before
+        */
+        ~ObjectPool()
+        {
+            ObjectPool::clearCache();
+        }
+
+        /*
+        * Construct a new object in place
+        */
+        template<class... Args>
+        T* create(Args&&... args)
+        {
+            return new(ObjectPool::allocate()) T(std::forward<Args>(args)...);
+        }
+
+        /*
+        * Destroy the object and return its memory to the pool
+        */
+        void destroy(T* object)
+        {
+            object->~T();
+            m_pool.freeMemory(object, sizeof(T));
+        }
+
+        /*
+        * Cached object in the state left by release(), default constructed one if the cache is empty
+        */
+        T* acquire()
+        {
+            if (m_countCached > 0)
+            {
+                return m_cache[--m_countCached];
+            }
+
+            return ObjectPool::create();
+        }
+
+        /*
+        * Keep the object constructed for acquire(), destroy it if the cache is full
+        */
+        void release(T* object)
+        {
+            if (m_countCached < m_cache.size())
+            {
+                m_cache[m_countCached++] = object;
+                return;
+            }
+
+            ObjectPool::destroy(object);
+        }
+
+        void clearCache()
+        {
+            while (m_countCached > 0)
+            {
+                ObjectPool::destroy(m_cache[--m_countCached]);
+            }
+        }
+
+        u32 getCountCached() const
+        {
+            return m_countCached;
+        }
+
+    private:
+
+        address_ptr allocate()
+        {
+            if constexpr (k_sizeClass != MemoryPool::k_invalidSizeClass)
+            {
+                return m_pool.allocFromSizeClass(k_sizeClass);
+            }
+            else
+            {
+                //bigger or over aligned objects
+                return m_pool.allocMemory(sizeof(T), alignof(T));
+            }
+        }
+
+        MemoryPool&         m_pool;
+        std::vector<T*>     m_cache;
+        u32                 m_countCached;
+    };
+
+} //namespace mem
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "MemoryPool.h"
+
+#include <type_traits>
+
+namespace mem
+{
+    /*
+    * class PoolAllocator. Standard allocator over a MemoryPool for containers
+    * Single element requests (container nodes) go straight to the small table of sizeof(T), resolved once per allocator.
+    * Memory is returned with its size. Copies and rebinds share the pool, the pool must outlive them. Not thread safe
+    */
+    template<class T>
+    class PoolAllocator
+    {
+    public:
+
+        using value_type = T;
+        using size_type = std::size_t;
+        using difference_type = std::ptrdiff_t;
+        using propagate_on_container_copy_assignment = std::true_type;
+        using propagate_on_container_move_assignment = std::true_type;
+        using propagate_on_container_swap = std::true_type;
+        using is_always_equal = std::false_type;
+
+        template<class U>
+        struct rebind
+        {
+            using other = PoolAllocator<U>;
+        };
+
+        explicit PoolAllocator(MemoryPool& pool) noexcept
+            : m_pool(&pool)
+            , m_sizeClass(pool.getSizeClass(sizeof(T), alignof(T)))
+        {
+        }
+
+        template<class U>
+        PoolAllocator(const PoolAllocator<U>& other) noexcept
+            : PoolAllocator(*other.getPool())
+        {
+        }
+
+        T* allocate(size_type count)
+        {
+            if (count == 1 && m_sizeClass != MemoryPool::k_invalidSizeClass)
+            {
+                return reinterpret_cast<T*>(m_pool->allocFromSizeClass(m_sizeClass));
+            }
+
+            return reinterpret_cast<T*>(m_pool->allocMemory(sizeof(T) * count, alignof(T)));
+        }
+
+        void deallocate(T* memory, size_type count)
+        {
+            m_pool->freeMemory(memory, sizeof(T) * count);
+        }
+
+        MemoryPool* getPool() const
+        {
+            return m_pool;
+        }
+
+    private:
+
+        MemoryPool* m_pool;
+        u32         m_sizeClass;
+    };
+
+    template<class T, class U>
+    bool operator==(const PoolAllocator<T>& left, const PoolAllocator<U>& right)
+    {
+        return left.getPool() == right.getPool();
+    }
+
+    template<class T, class U>
+    bool operator!=(const PoolAllocator<T>& left, const PoolAllocator<U>& right)
+    {
+        return left.getPool() != right.getPool();
+    }
+
+} //namespace mem
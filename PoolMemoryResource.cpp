@@ -0,0 +1,39 @@
+#include "PoolMemoryResource.h"
+
+#if MEMORY_POOL_RESOURCE
+namespace mem
+{
+    PoolMemoryResource::PoolMemoryResource(MemoryPool& pool) noexcept
+        : m_pool(pool)
+    {
+    }
+
+    MemoryPool& PoolMemoryResource::getPool() const
+    {
+        return m_pool;
+    }
+
+    void* PoolMemoryResource::do_allocate(std::size_t bytes, std::size_t alignment)
+    {
+        u32 aligment = static_cast<u32>(alignment);
+        if (u32 sizeClass = m_pool.getSizeClass(bytes, aligment); sizeClass != MemoryPool::k_invalidSizeClass)
+        {
+            return m_pool.allocFromSizeClass(sizeClass);
+        }
+
+        return m_pool.allocMemory(bytes, aligment);
+    }
+
+    void PoolMemoryResource::do_deallocate(void* memory, std::size_t bytes, std::size_t /*alignment*/)
+    {
+        m_pool.freeMemory(memory, bytes);
+    }
+
+    bool PoolMemoryResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+    {
+        //resources are not copyable, the same object shares the pool
+        return this == &other;
+    }
+
+} //namespace mem
+#endif //MEMORY_POOL_RESOURCE
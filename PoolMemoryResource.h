@@ -0,0 +1,45 @@
+#pragma once
+
+#include "MemoryPool.h"
+
+#if __has_include(<memory_resource>)
+#   include <memory_resource>
+#   define MEMORY_POOL_RESOURCE 1
+#else
+#   define MEMORY_POOL_RESOURCE 0
+#endif
+
+#if MEMORY_POOL_RESOURCE
+namespace mem
+{
+    /*
+    * class PoolMemoryResource. std::pmr::memory_resource over a MemoryPool
+    * Requests served by a small table skip the size dispatch of allocMemory, memory is returned with its size.
+    * The pool must outlive the resource. Not thread safe
+    */
+    class PoolMemoryResource final : public std::pmr::memory_resource
+    {
+    public:
+
+        PoolMemoryResource(const PoolMemoryResource&) = delete;
+        PoolMemoryResource& operator=(const PoolMemoryResource&) = delete;
+
+        /*
+        * PoolMemoryResource constuctor
+        * param pool: source of the memory
+        */
+        explicit PoolMemoryResource(MemoryPool& pool) noexcept;
+
+        MemoryPool& getPool() const;
+
+    private:
+
+        void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+        void do_deallocate(void* memory, std::size_t bytes, std::size_t alignment) override;
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+        MemoryPool& m_pool;
+    };
+
+} //namespace mem
+#endif //MEMORY_POOL_RESOURCE
@@ -1,4 +1,10 @@
 #include "MemoryPool.h"
+#include "ConcurrentMemoryPool.h"
+#include "FrameArena.h"
+#include "MemoryPressureMonitor.h"
+#include "PoolAllocator.h"
+#include "PoolMemoryResource.h"
+#include "ObjectPool.h"
 
 #include <assert.h>
 #include <memory>
@@ -8,11 +14,26 @@
 #include <type_traits>
 #include <functional>
 #include <thread>
+#include <mutex>
+#include <atomic>
+#include <fstream>
+#include <cstring>
+#include <map>
+#include <list>
+#include <unordered_map>
 
 #ifdef WIN32
 #include <windows.h>
 #endif
 
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif //__linux__
+
 #ifdef __ANDROID__
 #include <android/log.h>
 #include <unistd.h>
@@ -40,7 +61,11 @@ public:
     {
         s_heap = HeapCreate(0, 0, 0);
     }
-    ~WinMemoryAllocator() = default;
+
+    ~WinMemoryAllocator()
+    {
+        mem::PageCache::getInstance().clear(this);
+    }
 
     mem::address_ptr allocate(mem::u64 size, mem::u32 aligment = 0, void* user = nullptr) override
     {
@@ -71,7 +96,11 @@ class AndroidMemoryAllocator : public mem::MemoryPool::MemoryAllocator
 public:
 
     explicit AndroidMemoryAllocator() noexcept = default;
-    ~AndroidMemoryAllocator() = default;
+
+    ~AndroidMemoryAllocator()
+    {
+        mem::PageCache::getInstance().clear(this);
+    }
 
     mem::address_ptr allocate(mem::u64 size, mem::u32 aligment = 0, void* user = nullptr) override
     {
@@ -105,6 +134,7 @@ struct MemoryTestCallbacks
     std::function<void* volatile(size_t size, size_t aligment)> allocate;
     std::function<void(void*)> deallocate;
     std::function<void(void)> statistic;
+    std::function<void* volatile(void*, size_t size)> reallocate;
 };
 
 bool Test_0()
@@ -251,6 +281,25 @@ bool Test_1()
         std::cout << "POOL stat: (ms)" << (double)allocateTime / 1000.0 << " / " << (double)deallocateTime / 1000.0 << std::endl;
     }
 
+    //Memory Pool, header-free small blocks
+    {
+        mem::MemoryPool pool(g_pageSize, &g_allocator, false, nullptr, mem::MemoryPool::SmallTableLayout::AlignedSlab);
+        pool.preAllocatePools();
+        pool.collectStatistic();
+
+        MemoryTestCallbacks callbacks;
+        callbacks.allocate = [&pool](size_t size, size_t aligment) -> void* volatile { return pool.allocMemory(size, (mem::u32)aligment); };
+        callbacks.deallocate = [&pool](void* ptr) -> void { pool.freeMemory(ptr); };
+        callbacks.statistic = [&pool]() -> void { pool.collectStatistic(); };
+
+        allocateTime = 0;
+        deallocateTime = 0;
+        executeCallback(callbacks);
+
+        pool.collectStatistic();
+        std::cout << "POOL AlignedSlab stat: (ms)" << (double)allocateTime / 1000.0 << " / " << (double)deallocateTime / 1000.0 << std::endl;
+    }
+
     //STD malloc
     {
         MemoryTestCallbacks callbacks;
@@ -333,6 +382,24 @@ bool Test_2()
         std::cout << "POOL stat: (ms)" << (double)allocateTime / 1000.0 << " / " << (double)deallocateTime / 1000.0 << std::endl;
     }
 
+    //Memory Pool, header-free small blocks
+    {
+        mem::MemoryPool pool(g_pageSize, &g_allocator, true, nullptr, mem::MemoryPool::SmallTableLayout::AlignedSlab);
+        pool.preAllocatePools();
+
+        MemoryTestCallbacks callbacks;
+        callbacks.allocate = [&pool](size_t size, size_t aligment) -> void* volatile { return pool.allocMemory(size, (mem::u32)aligment); };
+        callbacks.deallocate = [&pool](void* ptr) -> void { pool.freeMemory(ptr); };
+        callbacks.statistic = [&pool]() -> void { pool.collectStatistic(); };
+
+        allocateTime = 0;
+        deallocateTime = 0;
+        executeCallback(callbacks);
+
+        pool.collectStatistic();
+        std::cout << "POOL AlignedSlab stat: (ms)" << (double)allocateTime / 1000.0 << " / " << (double)deallocateTime / 1000.0 << std::endl;
+    }
+
     //STD malloc
     {
         MemoryTestCallbacks callbacks;
@@ -1085,6 +1152,7 @@ bool Test_9()
     {
         mem::MemoryPool pool(g_pageSize, &g_allocator);
         pool.preAllocatePools();
+        pool.setLargeCacheLimit(maxMallocSize);
 
         MemoryTestCallbacks callbacks;
         callbacks.allocate = [&pool](size_t size, size_t aligment) -> void* volatile { return pool.allocMemory(size, (mem::u32)aligment); };
@@ -1096,7 +1164,26 @@ bool Test_9()
         executeCallback(callbacks);
 
         pool.collectStatistic();
-        std::cout << "POOL stat: (ms)" << (double)allocateTime / 1000.0 << " / " << (double)deallocateTime / 1000.0 << std::endl;
+        mem::MemoryPool::LargeCacheStatistic cacheStatistic = pool.getLargeCacheStatistic();
+        std::cout << "POOL stat: (ms)" << (double)allocateTime / 1000.0 << " / " << (double)deallocateTime / 1000.0
+            << ". Large cache hits/misses: " << cacheStatistic._hits << "/" << cacheStatistic._misses << std::endl;
+    }
+
+    //Memory Pool without large cache
+    {
+        mem::MemoryPool pool(g_pageSize, &g_allocator);
+        pool.setLargeCacheLimit(0);
+
+        MemoryTestCallbacks callbacks;
+        callbacks.allocate = [&pool](size_t size, size_t aligment) -> void* volatile { return pool.allocMemory(size, (mem::u32)aligment); };
+        callbacks.deallocate = [&pool](void* ptr) -> void { pool.freeMemory(ptr); };
+        callbacks.statistic = [&pool]() -> void { pool.collectStatistic(); };
+
+        allocateTime = 0;
+        deallocateTime = 0;
+        executeCallback(callbacks);
+
+        std::cout << "POOL no large cache: (ms)" << (double)allocateTime / 1000.0 << " / " << (double)deallocateTime / 1000.0 << std::endl;
     }
 
     //STD malloc
@@ -1131,22 +1218,2038 @@ bool Test_9()
     return true;
 }
 
+bool Test_10()
+{
+    std::cout << "----------------Test_10 (Small Allocation. Multithread scaling)" << std::endl;
+
+    const size_t countIter = 1'000'000;
+    const size_t countLive = 256;
+    const size_t maxMallocSize = 256;
+    const size_t maxCountThreads = std::max<size_t>(1, std::thread::hardware_concurrency());
 
-int main()
+    auto executeThreads = [&](size_t countThreads, std::function<void(size_t)> threadFunc) -> mem::u64
+    {
+        auto startTime = std::chrono::high_resolution_clock::now();
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < countThreads; ++t)
+        {
+            threads.emplace_back(threadFunc, t);
+        }
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+        auto endTime = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
+    };
+
+    auto executeCallback = [&](MemoryTestCallbacks& callbacks, size_t seed) -> void
+    {
+        std::mt19937 gen((unsigned int)seed);
+        std::uniform_int_distribution<size_t> dis(1, maxMallocSize);
+
+        std::vector<void*> live(countLive, nullptr);
+        for (size_t i = 0; i < countIter; ++i)
+        {
+            void*& ptr = live[i % countLive];
+            if (ptr)
+            {
+                callbacks.deallocate(ptr);
+            }
+
+            size_t size = dis(gen);
+            ptr = callbacks.allocate(size, 0);
+            assert(ptr != nullptr);
+            memset(ptr, (int)i, size);
+        }
+
+        for (auto& ptr : live)
+        {
+            callbacks.deallocate(ptr);
+        }
+    };
+
+    for (size_t countThreads = 1; countThreads <= maxCountThreads; countThreads *= 2)
+    {
+        std::cout << "Threads: " << countThreads << std::endl;
+
+        //Memory Pool + mutex
+        {
+            mem::MemoryPool pool(g_pageSize, &g_allocator, false);
+            std::mutex mutex;
+
+            mem::u64 time = executeThreads(countThreads, [&](size_t t) -> void
+                {
+                    MemoryTestCallbacks callbacks;
+                    callbacks.allocate = [&](size_t size, size_t aligment) -> void* volatile { std::lock_guard<std::mutex> lock(mutex); return pool.allocMemory(size, (mem::u32)aligment); };
+                    callbacks.deallocate = [&](void* ptr) -> void { std::lock_guard<std::mutex> lock(mutex); pool.freeMemory(ptr); };
+                    executeCallback(callbacks, t);
+                });
+
+            std::cout << "POOL + mutex: (ms)" << (double)time / 1000.0 << std::endl;
+        }
+
+        //Memory Pool + ThreadCache
+        {
+            mem::MemoryPool pool(g_pageSize, &g_allocator, false);
+
+            mem::u64 time = executeThreads(countThreads, [&](size_t t) -> void
+                {
+                    mem::MemoryPool::ThreadCache cache(pool);
+
+                    MemoryTestCallbacks callbacks;
+                    callbacks.allocate = [&cache](size_t size, size_t aligment) -> void* volatile { return cache.allocMemory(size, (mem::u32)aligment); };
+                    callbacks.deallocate = [&cache](void* ptr) -> void { cache.freeMemory(ptr); };
+                    executeCallback(callbacks, t);
+                });
+
+            std::cout << "POOL + ThreadCache: (ms)" << (double)time / 1000.0 << std::endl;
+        }
+
+        //Concurrent Memory Pool
+        {
+            mem::ConcurrentMemoryPool pool(g_pageSize, 0, &g_allocator, false);
+
+            mem::u64 time = executeThreads(countThreads, [&](size_t t) -> void
+                {
+                    MemoryTestCallbacks callbacks;
+                    callbacks.allocate = [&pool](size_t size, size_t aligment) -> void* volatile { return pool.allocMemory(size, (mem::u32)aligment); };
+                    callbacks.deallocate = [&pool](void* ptr) -> void { pool.freeMemory(ptr); };
+                    executeCallback(callbacks, t);
+                });
+
+            std::cout << "ConcurrentPool (" << pool.getCountShards() << " shards): (ms)" << (double)time / 1000.0 << std::endl;
+        }
+
+        //Mi_malloc
+        {
+            mem::u64 time = executeThreads(countThreads, [&](size_t t) -> void
+                {
+                    MemoryTestCallbacks callbacks;
+                    callbacks.allocate = [](size_t size, size_t aligment) -> void* volatile { return mi_malloc(size); };
+                    callbacks.deallocate = [](void* ptr) -> void { mi_free(ptr); };
+                    executeCallback(callbacks, t);
+                });
+
+            std::cout << "MImalloc: (ms)" << (double)time / 1000.0 << std::endl;
+        }
+    }
+
+    std::cout << "----------------Test_10 END" << std::endl;
+    return true;
+}
+
+bool Test_11()
 {
-#ifdef WIN32
-    SYSTEM_INFO systemInfo;
-    memset(&systemInfo, 0, sizeof(SYSTEM_INFO));
-    ::GetSystemInfo(&systemInfo);
+    std::cout << "----------------Test_11 (Small Allocation. Producer/Consumer cross thread free)" << std::endl;
 
-    g_pageSize = std::max<mem::u64>(mem::MemoryPool::k_mixSizePageSize, systemInfo.dwAllocationGranularity);
-#endif //WIN32
+    const size_t countIter = 1'000'000;
+    const size_t maxMallocSize = 256;
 
-#if __ANDROID__
-    android_log::start_logger("MemoryPool Test");
+    auto executeCallback = [&](MemoryTestCallbacks& callbacks) -> mem::u64
+    {
+        std::mutex mutex;
+        std::vector<std::pair<void*, size_t>> queue;
+        std::atomic<bool> done = false;
 
-    g_pageSize = std::max<mem::u64>(mem::MemoryPool::k_mixSizePageSize, (mem::u64)sysconf(_SC_PAGESIZE));
-#endif //__ANDROID__
+        auto startTime = std::chrono::high_resolution_clock::now();
+        std::thread consumer([&]() -> void
+            {
+                std::vector<std::pair<void*, size_t>> messages;
+                while (true)
+                {
+                    bool finished = done.load();
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        messages.swap(queue);
+                    }
+
+                    for (auto& message : messages)
+                    {
+                        char* ptr = reinterpret_cast<char*>(message.first);
+                        if (ptr[0] != (char)message.second || ptr[message.second - 1] != (char)message.second)
+                        {
+                            assert(false);
+                        }
+                        callbacks.deallocate(message.first);
+                    }
+
+                    if (finished && messages.empty())
+                    {
+                        break;
+                    }
+                    messages.clear();
+                }
+            });
+
+        std::mt19937 gen(0);
+        std::uniform_int_distribution<size_t> dis(1, maxMallocSize);
+        for (size_t i = 0; i < countIter; ++i)
+        {
+            size_t size = dis(gen);
+            void* volatile ptr = callbacks.allocate(size, 0);
+            assert(ptr != nullptr);
+            memset(ptr, (int)size, size);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back({ ptr, size });
+        }
+        done = true;
+        consumer.join();
+
+        auto endTime = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
+    };
+
+    //Memory Pool, consumer returns blocks to the remote lists
+    {
+        mem::MemoryPool pool(g_pageSize, &g_allocator);
+
+        MemoryTestCallbacks callbacks;
+        callbacks.allocate = [&pool](size_t size, size_t aligment) -> void* volatile { return pool.allocMemory(size, (mem::u32)aligment); };
+        callbacks.deallocate = [&pool](void* ptr) -> void { pool.freeMemory(ptr); };
+
+        mem::u64 time = executeCallback(callbacks);
+        pool.collectStatistic();
+        std::cout << "POOL stat: (ms)" << (double)time / 1000.0 << std::endl;
+    }
+
+    //Mi_malloc
+    {
+        MemoryTestCallbacks callbacks;
+        callbacks.allocate = [](size_t size, size_t aligment) -> void* volatile { return mi_malloc(size); };
+        callbacks.deallocate = [](void* ptr) -> void { mi_free(ptr); };
+
+        mem::u64 time = executeCallback(callbacks);
+        std::cout << "MImalloc: (ms)" << (double)time / 1000.0 << std::endl;
+    }
+
+    std::cout << "----------------Test_11 END" << std::endl;
+    return true;
+}
+
+bool Test_12()
+{
+    std::cout << "----------------Test_12 (Page cache. Many pools create/destroy)" << std::endl;
+
+    const size_t countIter = 200;
+    const size_t countPools = 32;
+    const size_t countAllocation = 256;
+
+    auto executePools = [&]() -> mem::u64
+    {
+        std::mt19937 gen(0);
+        std::uniform_int_distribution<size_t> dis(1, 64 * 1024);
+
+        auto startTime = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < countIter; ++i)
+        {
+            std::vector<std::unique_ptr<mem::MemoryPool>> pools;
+            for (size_t p = 0; p < countPools; ++p)
+            {
+                pools.push_back(std::make_unique<mem::MemoryPool>(g_pageSize, &g_allocator));
+            }
+
+            std::vector<std::pair<mem::MemoryPool*, void*>> pointers;
+            for (size_t j = 0; j < countAllocation; ++j)
+            {
+                mem::MemoryPool* pool = pools[j % countPools].get();
+                size_t size = dis(gen);
+                void* volatile ptr = pool->allocMemory(size);
+                assert(ptr != nullptr);
+                memset(ptr, (int)j, size);
+                pointers.push_back({ pool, ptr });
+            }
+
+            for (auto& ptr : pointers)
+            {
+                ptr.first->freeMemory(ptr.second);
+            }
+        }
+        auto endTime = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
+    };
+
+    mem::PageCache& cache = mem::PageCache::getInstance();
+    const mem::u64 retentionLimit = cache.getRetentionLimit();
+
+    //without cache
+    {
+        cache.setRetentionLimit(0);
+        mem::u64 time = executePools();
+        std::cout << "POOL without PageCache: (ms)" << (double)time / 1000.0 << std::endl;
+    }
+
+    //with cache, disabled by default
+    {
+        cache.setRetentionLimit(64 * 1024 * 1024);
+        mem::PageCache::Statistic before = cache.getStatistic();
+        mem::u64 time = executePools();
+        mem::PageCache::Statistic after = cache.getStatistic();
+
+        mem::u64 hits = after._hits - before._hits;
+        mem::u64 misses = after._misses - before._misses;
+        cache.collectStatistic();
+        std::cout << "POOL with PageCache: (ms)" << (double)time / 1000.0 << ". Backend allocations saved: " << hits << "/" << hits + misses << std::endl;
+    }
+    cache.setRetentionLimit(retentionLimit);
+
+    std::cout << "----------------Test_12 END" << std::endl;
+    return true;
+}
+
+
+bool Test_13()
+{
+    std::cout << "----------------Test_13 (Small Allocation. Blocks vs Slab vs AlignedSlab layout)" << std::endl;
+
+    const size_t countAllocation = 1'000'000;
+
+    //counts memory requested by the pool
+    class CountingAllocator : public mem::MemoryPool::MemoryAllocator
+    {
+    public:
+
+        ~CountingAllocator()
+        {
+            mem::PageCache::getInstance().clear(this);
+        }
+
+        mem::address_ptr allocate(mem::u64 size, mem::u32 aligment, void* user) override
+        {
+            _size += size;
+            _peakSize = std::max(_peakSize, _size);
+            return g_allocator.allocate(size, aligment, user);
+        }
+
+        void deallocate(mem::address_ptr memory, mem::u64 size, void* user) override
+        {
+            _size -= size;
+            g_allocator.deallocate(memory, size, user);
+        }
+
+        mem::u64 _size = 0;
+        mem::u64 _peakSize = 0;
+    };
+    static CountingAllocator s_allocator;
+
+    auto executeLayout = [&](mem::MemoryPool::SmallTableLayout layout) -> void
+    {
+        s_allocator._peakSize = s_allocator._size;
+        mem::u64 startSize = s_allocator._size;
+
+        mem::MemoryPool pool(g_pageSize, &s_allocator, true, nullptr, layout);
+
+        std::mt19937 gen(0);
+        std::uniform_int_distribution<size_t> dis(1, 16);
+
+        std::vector<void*> pointers(countAllocation);
+        auto startTime0 = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < countAllocation; ++i)
+        {
+            pointers[i] = pool.allocMemory(dis(gen));
+            assert(pointers[i] != nullptr);
+        }
+        auto endTime0 = std::chrono::high_resolution_clock::now();
+
+        std::shuffle(pointers.begin(), pointers.end(), gen);
+
+        auto startTime1 = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < countAllocation; ++i)
+        {
+            pool.freeMemory(pointers[i]);
+        }
+        auto endTime1 = std::chrono::high_resolution_clock::now();
+
+        mem::u64 allocateTime = std::chrono::duration_cast<std::chrono::microseconds>(endTime0 - startTime0).count();
+        mem::u64 deallocateTime = std::chrono::duration_cast<std::chrono::microseconds>(endTime1 - startTime1).count();
+        const char* names[] = { "POOL Blocks", "POOL Slab", "POOL AlignedSlab" };
+        std::cout << names[static_cast<mem::u32>(layout)] << " stat: (ms)" << (double)allocateTime / 1000.0 << " / " << (double)deallocateTime / 1000.0
+            << ". Peak size (byte): " << s_allocator._peakSize - startSize << std::endl;
+    };
+
+    //spans must come from the allocator to be counted
+    mem::PageCache& cache = mem::PageCache::getInstance();
+    const mem::u64 retentionLimit = cache.getRetentionLimit();
+    cache.setRetentionLimit(0);
+
+    executeLayout(mem::MemoryPool::SmallTableLayout::Blocks);
+    executeLayout(mem::MemoryPool::SmallTableLayout::Slab);
+    executeLayout(mem::MemoryPool::SmallTableLayout::AlignedSlab);
+
+    cache.setRetentionLimit(retentionLimit);
+
+    std::cout << "----------------Test_13 END" << std::endl;
+    return true;
+}
+
+bool Test_14()
+{
+    std::cout << "----------------Test_14 (Small Allocation. Pool growth latency)" << std::endl;
+
+    const size_t countAllocation = 200'000;
+
+    auto executeCallback = [&](MemoryTestCallbacks& callbacks) -> void
+    {
+        std::vector<void*> pointers(countAllocation);
+
+        mem::u64 allocateTime = 0;
+        mem::u64 maxAllocateTime = 0;
+        for (size_t i = 0; i < countAllocation; ++i)
+        {
+            auto startTime = std::chrono::high_resolution_clock::now();
+            pointers[i] = callbacks.allocate(16, 0);
+            auto endTime = std::chrono::high_resolution_clock::now();
+
+            mem::u64 time = std::chrono::duration_cast<std::chrono::nanoseconds>(endTime - startTime).count();
+            allocateTime += time;
+            maxAllocateTime = std::max(maxAllocateTime, time);
+        }
+
+        for (size_t i = 0; i < countAllocation; ++i)
+        {
+            callbacks.deallocate(pointers[i]);
+        }
+
+        std::cout << " alloc (ms)" << (double)allocateTime / 1'000'000.0 << ". Max single allocation (us): " << (double)maxAllocateTime / 1000.0 << std::endl;
+    };
+
+    //new pools must come from the allocator
+    mem::PageCache& cache = mem::PageCache::getInstance();
+    const mem::u64 retentionLimit = cache.getRetentionLimit();
+    cache.setRetentionLimit(0);
+
+    //Memory Pool
+    {
+        mem::MemoryPool pool(g_pageSize, &g_allocator);
+
+        MemoryTestCallbacks callbacks;
+        callbacks.allocate = [&pool](size_t size, size_t aligment) -> void* volatile { return pool.allocMemory(size, (mem::u32)aligment); };
+        callbacks.deallocate = [&pool](void* ptr) -> void { pool.freeMemory(ptr); };
+        callbacks.statistic = [&pool]() -> void { pool.collectStatistic(); };
+
+        std::cout << "POOL stat:";
+        executeCallback(callbacks);
+    }
+
+    //STD malloc
+    {
+        MemoryTestCallbacks callbacks;
+        callbacks.allocate = [](size_t size, size_t aligment) -> void* volatile { return malloc(size); };
+        callbacks.deallocate = [](void* ptr) -> void { free(ptr); };
+        callbacks.statistic = []() -> void {};
+
+        std::cout << "STD malloc:";
+        executeCallback(callbacks);
+    }
+
+    cache.setRetentionLimit(retentionLimit);
+
+    std::cout << "----------------Test_14 END" << std::endl;
+    return true;
+}
+
+bool Test_15()
+{
+    std::cout << "----------------Test_15 (Medium Allocation. Free latency with 100k live allocations)" << std::endl;
+
+    const size_t countAllocation = 100'000;
+    const size_t countBuckets = 10;
+
+    auto executeCallback = [&](MemoryTestCallbacks& callbacks) -> void
+    {
+        std::mt19937 gen(0);
+        std::uniform_int_distribution<size_t> dis(33 * 1024, 40 * 1024);
+
+        std::vector<void*> pointers(countAllocation);
+        for (size_t i = 0; i < countAllocation; ++i)
+        {
+            pointers[i] = callbacks.allocate(dis(gen), 0);
+            assert(pointers[i] != nullptr);
+        }
+        std::shuffle(pointers.begin(), pointers.end(), gen);
+
+        //free time of every 10% of the allocations, while the heap shrinks
+        std::cout << " free (ms) per " << countAllocation / countBuckets << ":";
+        for (size_t bucket = 0; bucket < countBuckets; ++bucket)
+        {
+            auto startTime = std::chrono::high_resolution_clock::now();
+            for (size_t i = bucket * countAllocation / countBuckets; i < (bucket + 1) * countAllocation / countBuckets; ++i)
+            {
+                callbacks.deallocate(pointers[i]);
+            }
+            auto endTime = std::chrono::high_resolution_clock::now();
+            std::cout << " " << (double)std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count() / 1000.0;
+        }
+        std::cout << std::endl;
+    };
+
+    //Memory Pool
+    {
+        mem::MemoryPool pool(g_pageSize, &g_allocator);
+
+        MemoryTestCallbacks callbacks;
+        callbacks.allocate = [&pool](size_t size, size_t aligment) -> void* volatile { return pool.allocMemory(size, (mem::u32)aligment); };
+        callbacks.deallocate = [&pool](void* ptr) -> void { pool.freeMemory(ptr); };
+        callbacks.statistic = [&pool]() -> void { pool.collectStatistic(); };
+
+        std::cout << "POOL stat:";
+        executeCallback(callbacks);
+    }
+
+    //STD malloc
+    {
+        MemoryTestCallbacks callbacks;
+        callbacks.allocate = [](size_t size, size_t aligment) -> void* volatile { return malloc(size); };
+        callbacks.deallocate = [](void* ptr) -> void { free(ptr); };
+        callbacks.statistic = []() -> void {};
+
+        std::cout << "STD malloc:";
+        executeCallback(callbacks);
+    }
+
+    std::cout << "----------------Test_15 END" << std::endl;
+    return true;
+}
+
+bool Test_16()
+{
+    std::cout << "----------------Test_16 (Medium allocation. Fragmentation)" << std::endl;
+
+    const size_t countAllocation = 20'000;
+
+    mem::MemoryPool pool(g_pageSize, &g_allocator);
+
+    std::mt19937 gen(0);
+    std::uniform_int_distribution<size_t> dis(32'769, g_pageSize);
+
+    std::vector<void*> pointers(countAllocation);
+    for (size_t i = 0; i < countAllocation; ++i)
+    {
+        pointers[i] = pool.allocMemory(dis(gen));
+    }
+
+    //free a half, the holes are taken by the smallest medium requests
+    std::shuffle(pointers.begin(), pointers.end(), gen);
+    for (size_t i = 0; i < countAllocation / 2; ++i)
+    {
+        pool.freeMemory(pointers[i]);
+        pointers[i] = pool.allocMemory(33 * 1024);
+    }
+
+    mem::u64 requestedSize = 0;
+    mem::u64 reservedSize = 0;
+    mem::u64 poolSize = 0;
+    std::vector<mem::MemoryPool::PoolFragmentation> fragmentation = pool.getMediumFragmentation();
+    for (auto& poolFragmentation : fragmentation)
+    {
+        requestedSize += poolFragmentation._requestedSize;
+        reservedSize += poolFragmentation._reservedSize;
+        poolSize += poolFragmentation._poolSize;
+    }
+    std::cout << "POOL Requested/Reserved/Pools (byte): " << requestedSize << "/" << reservedSize << "/" << poolSize
+        << ". Count Pools: " << fragmentation.size() << ". Slack: " << (double)(reservedSize - requestedSize) * 100.0 / (double)reservedSize << "%" << std::endl;
+
+    for (void* ptr : pointers)
+    {
+        pool.freeMemory(ptr);
+    }
+
+    std::cout << "----------------Test_16 END" << std::endl;
+    return true;
+}
+
+bool Test_17()
+{
+    std::cout << "----------------Test_17 (Realloc. Growing buffers)" << std::endl;
+
+    const size_t countBuffers = 64;
+    const size_t mediumStep = 256;
+    const size_t mediumMaxSize = 64 * 1024;
+    const size_t largeStep = 4 * 1024;
+    const size_t largeMaxSize = 16 * 1024 * 1024;
+
+    auto executeCallback = [&](MemoryTestCallbacks& callbacks) -> void
+    {
+        //interleaved buffers, neighbours grow as well
+        size_t countMoves = 0;
+        auto startTime = std::chrono::high_resolution_clock::now();
+        std::vector<void*> pointers(countBuffers, nullptr);
+        for (size_t size = mediumStep; size <= mediumMaxSize; size += mediumStep)
+        {
+            for (size_t i = 0; i < countBuffers; ++i)
+            {
+                void* ptr = callbacks.reallocate(pointers[i], size);
+                assert(ptr != nullptr);
+                assert(size == mediumStep || *reinterpret_cast<size_t*>(ptr) == i);
+                *reinterpret_cast<size_t*>(ptr) = i;
+                countMoves += (ptr != pointers[i]) ? 1 : 0;
+                pointers[i] = ptr;
+            }
+        }
+        for (void* ptr : pointers)
+        {
+            callbacks.deallocate(ptr);
+        }
+        auto endTime = std::chrono::high_resolution_clock::now();
+        std::cout << " medium " << countBuffers << " x " << mediumMaxSize / mediumStep << " reallocs: " << (double)std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count() / 1000.0 << " ms, moved " << countMoves;
+
+        //single large buffer
+        countMoves = 0;
+        startTime = std::chrono::high_resolution_clock::now();
+        void* buffer = nullptr;
+        for (size_t size = largeStep; size <= largeMaxSize; size += largeStep)
+        {
+            void* ptr = callbacks.reallocate(buffer, size);
+            assert(ptr != nullptr);
+            assert(size == largeStep || reinterpret_cast<char*>(ptr)[size - largeStep - 1] == 'x');
+            reinterpret_cast<char*>(ptr)[size - 1] = 'x';
+            countMoves += (ptr != buffer) ? 1 : 0;
+            buffer = ptr;
+        }
+        callbacks.deallocate(buffer);
+        endTime = std::chrono::high_resolution_clock::now();
+        std::cout << ". large " << largeMaxSize / largeStep << " reallocs: " << (double)std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count() / 1000.0 << " ms, moved " << countMoves << std::endl;
+    };
+
+    //Memory Pool
+    {
+        mem::MemoryPool pool(g_pageSize, &g_allocator);
+
+        MemoryTestCallbacks callbacks;
+        callbacks.deallocate = [&pool](void* ptr) -> void { pool.freeMemory(ptr); };
+        callbacks.reallocate = [&pool](void* ptr, size_t size) -> void* volatile { return pool.reallocMemory(ptr, size); };
+
+        std::cout << "POOL stat:";
+        executeCallback(callbacks);
+    }
+
+    //STD malloc
+    {
+        MemoryTestCallbacks callbacks;
+        callbacks.deallocate = [](void* ptr) -> void { free(ptr); };
+        callbacks.reallocate = [](void* ptr, size_t size) -> void* volatile { return realloc(ptr, size); };
+
+        std::cout << "STD malloc:";
+        executeCallback(callbacks);
+    }
+
+    //MImalloc
+    {
+        MemoryTestCallbacks callbacks;
+        callbacks.deallocate = [](void* ptr) -> void { mi_free(ptr); };
+        callbacks.reallocate = [](void* ptr, size_t size) -> void* volatile { return mi_realloc(ptr, size); };
+
+        std::cout << "MImalloc:";
+        executeCallback(callbacks);
+    }
+
+    std::cout << "----------------Test_17 END" << std::endl;
+    return true;
+}
+
+bool Test_18()
+{
+    std::cout << "----------------Test_18 (Aligned allocation. Cache line and SIMD buffers)" << std::endl;
+
+    const size_t countAllocation = 100'000;
+
+    auto executeCallback = [&](MemoryTestCallbacks& callbacks) -> void
+    {
+        std::mt19937 gen(0);
+        std::uniform_int_distribution<size_t> disSize(8, 2048);
+        std::uniform_int_distribution<size_t> disAligment(3, 12);
+
+        std::vector<void*> pointers(countAllocation);
+        auto startTime = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < countAllocation; ++i)
+        {
+            //a half is cache line aligned, the rest from 8 bytes to a page
+            size_t aligment = (i & 1) ? 64 : (size_t)1 << disAligment(gen);
+            pointers[i] = callbacks.allocate(disSize(gen), aligment);
+            assert(pointers[i] != nullptr && (reinterpret_cast<size_t>(pointers[i]) & (aligment - 1)) == 0);
+        }
+        auto endTime = std::chrono::high_resolution_clock::now();
+        mem::u64 allocateTime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
+
+        std::shuffle(pointers.begin(), pointers.end(), gen);
+        startTime = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < countAllocation; ++i)
+        {
+            callbacks.deallocate(pointers[i]);
+        }
+        endTime = std::chrono::high_resolution_clock::now();
+        mem::u64 deallocateTime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
+
+        std::cout << " (ms)" << (double)allocateTime / 1000.0 << " / " << (double)deallocateTime / 1000.0 << std::endl;
+    };
+
+    //Memory Pool
+    {
+        mem::MemoryPool pool(g_pageSize, &g_allocator);
+
+        MemoryTestCallbacks callbacks;
+        callbacks.allocate = [&pool](size_t size, size_t aligment) -> void* volatile { return pool.allocMemory(size, (mem::u32)aligment); };
+        callbacks.deallocate = [&pool](void* ptr) -> void { pool.freeMemory(ptr); };
+        callbacks.statistic = [&pool]() -> void { pool.collectStatistic(); };
+
+        std::cout << "POOL stat:";
+        executeCallback(callbacks);
+    }
+
+    //STD aligned malloc
+    {
+        MemoryTestCallbacks callbacks;
+#ifdef _MSC_VER
+        callbacks.allocate = [](size_t size, size_t aligment) -> void* volatile { return _aligned_malloc(size, aligment); };
+        callbacks.deallocate = [](void* ptr) -> void { _aligned_free(ptr); };
+#else
+        callbacks.allocate = [](size_t size, size_t aligment) -> void* volatile { return aligned_alloc(aligment, (size + aligment - 1) & ~(aligment - 1)); };
+        callbacks.deallocate = [](void* ptr) -> void { free(ptr); };
+#endif
+        callbacks.statistic = []() -> void {};
+
+        std::cout << "STD malloc:";
+        executeCallback(callbacks);
+    }
+
+    //MImalloc
+    {
+        MemoryTestCallbacks callbacks;
+        callbacks.allocate = [](size_t size, size_t aligment) -> void* volatile { return mi_malloc_aligned(size, aligment); };
+        callbacks.deallocate = [](void* ptr) -> void { mi_free(ptr); };
+        callbacks.statistic = []() -> void {};
+
+        std::cout << "MImalloc:";
+        executeCallback(callbacks);
+    }
+
+    std::cout << "----------------Test_18 END" << std::endl;
+    return true;
+}
+
+bool Test_19()
+{
+    std::cout << "----------------Test_19 (Cache line allocation. Per thread counters)" << std::endl;
+
+    const size_t countIterations = 20'000'000;
+    const size_t countThreads = std::max<size_t>(2, std::min<size_t>(8, std::thread::hardware_concurrency()));
+
+    struct alignas(mem::MemoryPool::k_cacheLineSize) CacheLineCounter
+    {
+        std::atomic<mem::u64> _value;
+    };
+
+    auto executeCallback = [&](std::vector<std::atomic<mem::u64>*>& counters) -> void
+    {
+        auto startTime = std::chrono::high_resolution_clock::now();
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < countThreads; ++t)
+        {
+            threads.emplace_back([&counters, countIterations, t]()
+                {
+                    for (size_t i = 0; i < countIterations; ++i)
+                    {
+                        counters[t]->fetch_add(1, std::memory_order_relaxed);
+                    }
+                });
+        }
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+        auto endTime = std::chrono::high_resolution_clock::now();
+
+        for (auto counter : counters)
+        {
+            assert(counter->load() == countIterations);
+        }
+        std::cout << " threads " << countThreads << " (ms) " << (double)std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count() / 1000.0 << std::endl;
+    };
+
+    mem::MemoryPool pool(g_pageSize, &g_allocator);
+
+    //default aligment, neighbour counters share a line
+    {
+        std::vector<std::atomic<mem::u64>*> counters(countThreads);
+        for (auto& counter : counters)
+        {
+            counter = new(pool.allocElement<std::atomic<mem::u64>>()) std::atomic<mem::u64>(0);
+        }
+
+        std::cout << "POOL default:";
+        executeCallback(counters);
+        for (auto counter : counters)
+        {
+            pool.freeMemory(counter);
+        }
+    }
+
+    //cache line tables
+    {
+        std::vector<CacheLineCounter*> lines(countThreads);
+        std::vector<std::atomic<mem::u64>*> counters(countThreads);
+        for (size_t i = 0; i < countThreads; ++i)
+        {
+            lines[i] = new(pool.allocElement<CacheLineCounter>()) CacheLineCounter();
+            assert((reinterpret_cast<size_t>(lines[i]) & (mem::MemoryPool::k_cacheLineSize - 1)) == 0);
+            lines[i]->_value = 0;
+            counters[i] = &lines[i]->_value;
+        }
+
+        std::cout << "POOL cache line:";
+        executeCallback(counters);
+        for (auto line : lines)
+        {
+            pool.freeMemory(line);
+        }
+    }
+
+    std::cout << "----------------Test_19 END" << std::endl;
+    return true;
+}
+
+bool Test_20()
+{
+    std::cout << "----------------Test_20 (Virtual memory allocator. Large allocation churn)" << std::endl;
+
+#if defined(__linux__)
+    const size_t countIter = 2000;
+    const size_t countLive = 16;
+
+    std::mt19937 gen(20);
+    std::uniform_int_distribution<size_t> dis(256 * 1024, 8 * 1024 * 1024);
+
+    mem::u64 allocateTime = 0;
+    mem::u64 deallocateTime = 0;
+
+    auto executeCallback = [&](MemoryTestCallbacks& callbacks) -> void
+    {
+        std::vector<void*> ptrs(countLive, nullptr);
+        for (size_t i = 0; i < countIter; ++i)
+        {
+            size_t index = i % countLive;
+            if (ptrs[index])
+            {
+                auto startTime1 = std::chrono::high_resolution_clock::now();
+                callbacks.deallocate(ptrs[index]);
+                auto endTime1 = std::chrono::high_resolution_clock::now();
+                deallocateTime += std::chrono::duration_cast<std::chrono::microseconds>(endTime1 - startTime1).count();
+            }
+
+            size_t size = dis(gen);
+            auto startTime0 = std::chrono::high_resolution_clock::now();
+            ptrs[index] = callbacks.allocate(size, 0);
+            auto endTime0 = std::chrono::high_resolution_clock::now();
+            allocateTime += std::chrono::duration_cast<std::chrono::microseconds>(endTime0 - startTime0).count();
+
+            assert(ptrs[index] != nullptr);
+            memset(ptrs[index], (int)i, size);
+        }
+
+        for (void* ptr : ptrs)
+        {
+            callbacks.deallocate(ptr);
+        }
+    };
+
+    //large cache is disabled, every block goes to allocator
+    {
+        mem::DefaultMemoryAllocator allocator;
+        mem::MemoryPool pool(g_pageSize, &allocator);
+        pool.setLargeCacheLimit(0);
+
+        MemoryTestCallbacks callbacks;
+        callbacks.allocate = [&pool](size_t size, size_t aligment) -> void* volatile { return pool.allocMemory(size, (mem::u32)aligment); };
+        callbacks.deallocate = [&pool](void* ptr) -> void { pool.freeMemory(ptr); };
+        callbacks.statistic = [&pool]() -> void { pool.collectStatistic(); };
+
+        allocateTime = 0;
+        deallocateTime = 0;
+        executeCallback(callbacks);
+
+        std::cout << "POOL default allocator: (ms)" << (double)allocateTime / 1000.0 << " / " << (double)deallocateTime / 1000.0 << std::endl;
+    }
+
+    for (auto mode : { mem::LinuxVirtualMemoryAllocator::PurgeMode::DontNeed, mem::LinuxVirtualMemoryAllocator::PurgeMode::Free })
+    {
+        mem::LinuxVirtualMemoryAllocator allocator(mem::LinuxVirtualMemoryAllocator::k_defaultReserveSize, mode);
+        {
+            mem::MemoryPool pool(g_pageSize, &allocator);
+            pool.setLargeCacheLimit(0);
+
+            MemoryTestCallbacks callbacks;
+            callbacks.allocate = [&pool](size_t size, size_t aligment) -> void* volatile { return pool.allocMemory(size, (mem::u32)aligment); };
+            callbacks.deallocate = [&pool](void* ptr) -> void { pool.freeMemory(ptr); };
+            callbacks.statistic = [&pool]() -> void { pool.collectStatistic(); };
+
+            allocateTime = 0;
+            deallocateTime = 0;
+            executeCallback(callbacks);
+        }
+
+        mem::LinuxVirtualMemoryAllocator::Statistic statistic = allocator.getStatistic();
+        std::cout << "POOL virtual allocator " << (mode == mem::LinuxVirtualMemoryAllocator::PurgeMode::Free ? "MADV_FREE" : "MADV_DONTNEED")
+            << ": (ms)" << (double)allocateTime / 1000.0 << " / " << (double)deallocateTime / 1000.0
+            << ". Purged (MB): " << statistic._purgedSize / (1024 * 1024) << ", external (MB): " << statistic._externalSize / (1024 * 1024) << std::endl;
+    }
+
+    //STD malloc
+    {
+        MemoryTestCallbacks callbacks;
+        callbacks.allocate = [](size_t size, size_t aligment) -> void* volatile { return malloc(size); };
+        callbacks.deallocate = [](void* ptr) -> void { free(ptr); };
+        callbacks.statistic = []() -> void {};
+
+        allocateTime = 0;
+        deallocateTime = 0;
+        executeCallback(callbacks);
+
+        std::cout << "STD malloc: (ms)" << (double)allocateTime / 1000.0 << " / " << (double)deallocateTime / 1000.0 << std::endl;
+    }
+#endif //__linux__
+
+    std::cout << "----------------Test_20 END" << std::endl;
+    return true;
+}
+
+#if defined(__linux__)
+/*
+* dTLB load misses of the calling thread, perf events
+*/
+class TlbMissCounter
+{
+public:
+
+    TlbMissCounter() noexcept
+        : m_fd(-1)
+    {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(perf_event_attr));
+        attr.size = sizeof(perf_event_attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        m_fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    ~TlbMissCounter()
+    {
+        if (m_fd >= 0)
+        {
+            close(m_fd);
+        }
+    }
+
+    bool isAvailable() const
+    {
+        return m_fd >= 0;
+    }
+
+    void start()
+    {
+        if (m_fd >= 0)
+        {
+            ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    mem::u64 stop()
+    {
+        mem::u64 count = 0;
+        if (m_fd >= 0)
+        {
+            ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(m_fd, &count, sizeof(mem::u64)) != sizeof(mem::u64))
+            {
+                count = 0;
+            }
+        }
+        return count;
+    }
+
+private:
+
+    int m_fd;
+};
+#endif //__linux__
+
+bool Test_21()
+{
+    std::cout << "----------------Test_21 (Huge pages. dTLB misses of random access)" << std::endl;
+
+#if defined(__linux__)
+    const size_t countAllocations = 1'000'000;
+    const size_t countAccesses = 20'000'000;
+
+    std::mt19937 gen(21);
+    std::uniform_int_distribution<size_t> dis(16, 512);
+
+    auto executeCallback = [&](mem::MemoryPool& pool) -> void
+    {
+        std::vector<mem::u64*> ptrs(countAllocations);
+        for (size_t i = 0; i < countAllocations; ++i)
+        {
+            ptrs[i] = reinterpret_cast<mem::u64*>(pool.allocMemory(dis(gen)));
+            *ptrs[i] = i;
+        }
+
+        TlbMissCounter counter;
+        std::mt19937 accessGen(21);
+        std::uniform_int_distribution<size_t> accessDis(0, countAllocations - 1);
+        mem::u64 sum = 0;
+
+        auto startTime = std::chrono::high_resolution_clock::now();
+        counter.start();
+        for (size_t i = 0; i < countAccesses; ++i)
+        {
+            sum += *ptrs[accessDis(accessGen)];
+        }
+        mem::u64 misses = counter.stop();
+        auto endTime = std::chrono::high_resolution_clock::now();
+
+        for (mem::u64* ptr : ptrs)
+        {
+            pool.freeMemory(ptr);
+        }
+
+        std::cout << " access (ms) " << (double)std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count() / 1000.0 << " (" << sum << ")"
+            << ", dTLB load misses: ";
+        if (counter.isAvailable())
+        {
+            std::cout << misses << std::endl;
+        }
+        else
+        {
+            std::cout << "perf events are not available" << std::endl;
+        }
+    };
+
+    for (bool hugePages : { false, true })
+    {
+        mem::LinuxVirtualMemoryAllocator allocator(mem::LinuxVirtualMemoryAllocator::k_defaultReserveSize, mem::LinuxVirtualMemoryAllocator::PurgeMode::Free, hugePages);
+        {
+            mem::MemoryPool pool(allocator.getMemoryPoolPageSize(g_pageSize), &allocator);
+
+            std::cout << (hugePages ? "POOL huge pages:" : "POOL small pages:");
+            executeCallback(pool);
+        }
+    }
+#endif //__linux__
+
+    std::cout << "----------------Test_21 END" << std::endl;
+    return true;
+}
+
+bool Test_22()
+{
+    std::cout << "----------------Test_22 (Reserved region. Ownership check)" << std::endl;
+
+    const size_t countAllocations = 500'000;
+    const size_t maxSize = 4096;
+
+    std::mt19937 gen(22);
+    std::uniform_int_distribution<size_t> dis(1, maxSize);
+    std::vector<size_t> sizes(countAllocations);
+    for (size_t& size : sizes)
+    {
+        size = dis(gen);
+    }
+
+    auto executeCallback = [&](mem::MemoryPool& pool, bool region) -> void
+    {
+        std::vector<void*> ptrs(countAllocations);
+
+        auto startTime0 = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < countAllocations; ++i)
+        {
+            ptrs[i] = pool.allocMemory(sizes[i]);
+        }
+        auto endTime0 = std::chrono::high_resolution_clock::now();
+
+        size_t countOwned = 0;
+        auto startTime1 = std::chrono::high_resolution_clock::now();
+        if (region)
+        {
+            for (void* ptr : ptrs)
+            {
+                countOwned += pool.owns(ptr) ? 1 : 0;
+            }
+
+            int local = 0;
+            std::unique_ptr<int> foreign = std::make_unique<int>(0);
+            assert(!pool.owns(&local) && !pool.owns(foreign.get()));
+        }
+        auto endTime1 = std::chrono::high_resolution_clock::now();
+        assert(!region || countOwned == countAllocations);
+
+        auto startTime2 = std::chrono::high_resolution_clock::now();
+        for (void* ptr : ptrs)
+        {
+            pool.freeMemory(ptr);
+        }
+        auto endTime2 = std::chrono::high_resolution_clock::now();
+
+        std::cout << " (ms) alloc " << (double)std::chrono::duration_cast<std::chrono::microseconds>(endTime0 - startTime0).count() / 1000.0
+            << ", owns " << (double)std::chrono::duration_cast<std::chrono::microseconds>(endTime1 - startTime1).count() / 1000.0
+            << ", free " << (double)std::chrono::duration_cast<std::chrono::microseconds>(endTime2 - startTime2).count() / 1000.0 << std::endl;
+    };
+
+    {
+        mem::MemoryPool pool(g_pageSize, &g_allocator);
+
+        std::cout << "POOL:";
+        executeCallback(pool, false);
+    }
+
+    {
+        mem::MemoryPool pool(g_pageSize, &g_allocator);
+        pool.reserveRegion(countAllocations * maxSize);
+
+        std::cout << "POOL region:";
+        executeCallback(pool, true);
+    }
+
+#if defined(__linux__)
+    //trim returns the pages of released region pools
+    {
+        const size_t countBlocks = 4096;
+        mem::LinuxVirtualMemoryAllocator allocator(mem::LinuxVirtualMemoryAllocator::k_defaultReserveSize, mem::LinuxVirtualMemoryAllocator::PurgeMode::DontNeed);
+        mem::MemoryPool pool(g_pageSize, &allocator, false);
+        pool.reserveRegion(2 * countBlocks * maxSize);
+
+        std::vector<void*> ptrs(countBlocks);
+        for (void*& ptr : ptrs)
+        {
+            ptr = pool.allocMemory(maxSize);
+            memset(ptr, 1, maxSize);
+        }
+        for (void* ptr : ptrs)
+        {
+            pool.freeMemory(ptr);
+        }
+
+        //pages of the freed blocks still mapped in memory
+        const size_t systemPageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        auto countResident = [&]() -> size_t
+        {
+            size_t count = 0;
+            for (void* ptr : ptrs)
+            {
+                unsigned char resident = 0;
+                void* page = reinterpret_cast<void*>(reinterpret_cast<size_t>(ptr) & ~(systemPageSize - 1));
+                if (mincore(page, systemPageSize, &resident) == 0)
+                {
+                    count += resident & 1;
+                }
+            }
+            return count;
+        };
+
+        size_t residentBefore = countResident();
+        mem::u64 purgedBefore = allocator.getStatistic()._purgedSize;
+        mem::u64 releasedSize = pool.trim(0);
+        mem::u64 purgedSize = allocator.getStatistic()._purgedSize - purgedBefore;
+        size_t residentAfter = countResident();
+
+        std::cout << "POOL region trim: released (MB) " << releasedSize / (1024 * 1024) << ", purged (MB) " << purgedSize / (1024 * 1024)
+            << ", resident blocks " << residentBefore << " -> " << residentAfter << std::endl;
+        if (releasedSize == 0 || purgedSize < releasedSize || residentAfter >= residentBefore)
+        {
+            return false;
+        }
+    }
+#endif //__linux__
+
+    std::cout << "----------------Test_22 END" << std::endl;
+    return true;
+}
+
+bool Test_23()
+{
+    std::cout << "----------------Test_23 (Frame arena. Per frame temporaries)" << std::endl;
+
+    const size_t countFrames = 1000;
+    const size_t countAllocations = 10'000;
+
+    std::mt19937 gen(23);
+    std::uniform_int_distribution<size_t> dis(16, 256);
+    std::vector<size_t> sizes(countAllocations);
+    for (size_t& size : sizes)
+    {
+        size = dis(gen);
+    }
+
+    std::vector<void*> ptrs(countAllocations);
+    auto executeCallback = [&](MemoryTestCallbacks& callbacks, std::function<void(void)> endFrame) -> void
+    {
+        auto startTime = std::chrono::high_resolution_clock::now();
+        for (size_t frame = 0; frame < countFrames; ++frame)
+        {
+            for (size_t i = 0; i < countAllocations; ++i)
+            {
+                ptrs[i] = callbacks.allocate(sizes[i], 0);
+                assert(ptrs[i] != nullptr);
+                memset(ptrs[i], (int)frame, sizes[i]);
+            }
+
+            if (callbacks.deallocate)
+            {
+                for (void* ptr : ptrs)
+                {
+                    callbacks.deallocate(ptr);
+                }
+            }
+            endFrame();
+        }
+        auto endTime = std::chrono::high_resolution_clock::now();
+
+        std::cout << " frames " << countFrames << " (ms) " << (double)std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count() / 1000.0 << std::endl;
+    };
+
+    {
+        mem::MemoryPool pool(g_pageSize, &g_allocator);
+
+        MemoryTestCallbacks callbacks;
+        callbacks.allocate = [&pool](size_t size, size_t aligment) -> void* volatile { return pool.allocMemory(size, (mem::u32)aligment); };
+        callbacks.deallocate = [&pool](void* ptr) -> void { pool.freeMemory(ptr); };
+
+        std::cout << "POOL:";
+        executeCallback(callbacks, []() -> void {});
+    }
+
+    //nested scope per frame, the frame is dropped by rewind
+    {
+        mem::MemoryPool pool(g_pageSize, &g_allocator);
+        mem::FrameArena arena(pool);
+        mem::FrameArena::Mark frameMark = arena.mark();
+
+        MemoryTestCallbacks callbacks;
+        callbacks.allocate = [&arena](size_t size, size_t aligment) -> void* volatile { return arena.allocMemory(size, (mem::u32)aligment); };
+
+        std::cout << "POOL frame arena:";
+        executeCallback(callbacks, [&arena, &frameMark]() -> void { arena.rewind(frameMark); });
+        std::cout << " reserved (KB) " << arena.getReservedSize() / 1024 << std::endl;
+    }
+
+    //STD malloc
+    {
+        MemoryTestCallbacks callbacks;
+        callbacks.allocate = [](size_t size, size_t aligment) -> void* volatile { return malloc(size); };
+        callbacks.deallocate = [](void* ptr) -> void { free(ptr); };
+
+        std::cout << "STD malloc:";
+        executeCallback(callbacks, []() -> void {});
+    }
+
+    std::cout << "----------------Test_23 END" << std::endl;
+    return true;
+}
+
+bool Test_24()
+{
+    std::cout << "----------------Test_24 (Reset. 1M live small blocks)" << std::endl;
+
+    const size_t countRounds = 10;
+    const size_t countAllocations = 1'000'000;
+
+    std::mt19937 gen(24);
+    std::uniform_int_distribution<size_t> dis(8, 512);
+    std::vector<size_t> sizes(countAllocations);
+    for (size_t& size : sizes)
+    {
+        size = dis(gen);
+    }
+
+    std::vector<void*> ptrs(countAllocations);
+    mem::u64 allocateTime = 0;
+    mem::u64 releaseTime = 0;
+
+    auto executeCallback = [&](mem::MemoryPool& pool, std::function<void(void)> release) -> void
+    {
+        allocateTime = 0;
+        releaseTime = 0;
+        for (size_t round = 0; round < countRounds; ++round)
+        {
+            auto startTime0 = std::chrono::high_resolution_clock::now();
+            for (size_t i = 0; i < countAllocations; ++i)
+            {
+                ptrs[i] = pool.allocMemory(sizes[i]);
+                *reinterpret_cast<size_t*>(ptrs[i]) = i;
+            }
+            auto endTime0 = std::chrono::high_resolution_clock::now();
+
+            for (size_t i = 0; i < countAllocations; ++i)
+            {
+                assert(*reinterpret_cast<size_t*>(ptrs[i]) == i);
+            }
+
+            auto startTime1 = std::chrono::high_resolution_clock::now();
+            release();
+            auto endTime1 = std::chrono::high_resolution_clock::now();
+
+            //first round creates the pools
+            if (round > 0)
+            {
+                allocateTime += std::chrono::duration_cast<std::chrono::microseconds>(endTime0 - startTime0).count();
+                releaseTime += std::chrono::duration_cast<std::chrono::nanoseconds>(endTime1 - startTime1).count();
+            }
+        }
+
+        std::cout << " per round (ms) alloc " << (double)allocateTime / 1000.0 / (countRounds - 1)
+            << ", release " << (double)releaseTime / 1'000'000.0 / (countRounds - 1) << std::endl;
+    };
+
+    {
+        mem::MemoryPool pool(g_pageSize, &g_allocator, false);
+
+        std::cout << "POOL free all:";
+        executeCallback(pool, [&pool, &ptrs]() -> void
+            {
+                for (void* ptr : ptrs)
+                {
+                    pool.freeMemory(ptr);
+                }
+            });
+    }
+
+    {
+        mem::MemoryPool pool(g_pageSize, &g_allocator);
+
+        std::cout << "POOL reset:";
+        executeCallback(pool, [&pool]() -> void { pool.reset(); });
+    }
+
+    {
+        mem::MemoryPool pool(g_pageSize, &g_allocator, true, nullptr, mem::MemoryPool::SmallTableLayout::Slab);
+
+        std::cout << "POOL slab reset:";
+        executeCallback(pool, [&pool]() -> void { pool.reset(); });
+    }
+
+    std::cout << "----------------Test_24 END" << std::endl;
+    return true;
+}
+
+bool Test_25()
+{
+    std::cout << "----------------Test_25 (Sub-heaps. Short lived sessions)" << std::endl;
+
+    const size_t countSessions = 2000;
+    const size_t countAllocations = 5000;
+
+    std::mt19937 gen(25);
+    std::uniform_int_distribution<size_t> dis(16, 2048);
+    std::vector<size_t> sizes(countAllocations);
+    for (size_t& size : sizes)
+    {
+        size = dis(gen);
+    }
+
+    std::vector<void*> ptrs(countAllocations);
+    auto executeCallback = [&](std::function<mem::MemoryPool*(void)> create, std::function<void(mem::MemoryPool*)> destroy) -> void
+    {
+        mem::u64 createTime = 0;
+        mem::u64 destroyTime = 0;
+        auto startTime = std::chrono::high_resolution_clock::now();
+        for (size_t session = 0; session < countSessions; ++session)
+        {
+            auto startTime0 = std::chrono::high_resolution_clock::now();
+            mem::MemoryPool* pool = create();
+            auto endTime0 = std::chrono::high_resolution_clock::now();
+
+            for (size_t i = 0; i < countAllocations; ++i)
+            {
+                ptrs[i] = pool->allocMemory(sizes[i]);
+                memset(ptrs[i], (int)session, sizes[i]);
+            }
+
+            auto startTime1 = std::chrono::high_resolution_clock::now();
+            destroy(pool);
+            auto endTime1 = std::chrono::high_resolution_clock::now();
+
+            createTime += std::chrono::duration_cast<std::chrono::nanoseconds>(endTime0 - startTime0).count();
+            destroyTime += std::chrono::duration_cast<std::chrono::nanoseconds>(endTime1 - startTime1).count();
+        }
+        auto endTime = std::chrono::high_resolution_clock::now();
+
+        std::cout << " total (ms) " << (double)std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count() / 1000.0
+            << ", per session (us) create " << (double)createTime / 1000.0 / countSessions << ", destroy " << (double)destroyTime / 1000.0 / countSessions << std::endl;
+    };
+
+    //MemoryPool per session, blocks are freed one by one
+    {
+        std::cout << "POOL per session:";
+        executeCallback([]() -> mem::MemoryPool* { return new mem::MemoryPool(g_pageSize, &g_allocator); },
+            [&ptrs](mem::MemoryPool* pool) -> void
+            {
+                for (void* ptr : ptrs)
+                {
+                    pool->freeMemory(ptr);
+                }
+                delete pool;
+            });
+    }
+
+    //heap per session, spans are kept by the parent
+    {
+        mem::MemoryPool parent(g_pageSize, &g_allocator);
+
+        std::cout << "POOL heap per session:";
+        executeCallback([&parent]() -> mem::MemoryPool* { return parent.createHeap(); },
+            [&parent](mem::MemoryPool* heap) -> void { parent.destroyHeap(heap); });
+    }
+
+    std::cout << "----------------Test_25 END" << std::endl;
+    return true;
+}
+
+bool Test_26()
+{
+    std::cout << "----------------Test_26 (Trim and memory budget. Burst then idle)" << std::endl;
+
+    const size_t countBursts = 20;
+    const size_t countAllocations = 40000;
+    const mem::u64 budget = 64 * 1024 * 1024;
+
+    std::mt19937 gen(26);
+    std::uniform_int_distribution<size_t> dis(16, 8192);
+    std::vector<size_t> sizes(countAllocations);
+    for (size_t i = 0; i < countAllocations; ++i)
+    {
+        //a few large allocations per burst
+        sizes[i] = (i % 1000 == 0) ? 1024 * 1024 : dis(gen);
+    }
+
+    std::vector<void*> ptrs(countAllocations);
+    auto executeCallback = [&](mem::MemoryPool& pool, bool trim) -> void
+    {
+        mem::u64 peakFootprint = 0;
+        mem::u64 idleFootprint = 0;
+        mem::u64 trimTime = 0;
+        auto startTime = std::chrono::high_resolution_clock::now();
+        for (size_t burst = 0; burst < countBursts; ++burst)
+        {
+            for (size_t i = 0; i < countAllocations; ++i)
+            {
+                ptrs[i] = pool.allocMemory(sizes[i]);
+                memset(ptrs[i], (int)burst, std::min<size_t>(sizes[i], 64));
+            }
+            peakFootprint = std::max(peakFootprint, pool.getFootprint());
+
+            //keep the oldest allocations alive over the idle phase
+            const size_t countAlive = countAllocations / 16;
+            for (size_t i = countAlive; i < countAllocations; ++i)
+            {
+                pool.freeMemory(ptrs[i]);
+            }
+
+            if (trim)
+            {
+                auto startTime0 = std::chrono::high_resolution_clock::now();
+                pool.trim(0);
+                auto endTime0 = std::chrono::high_resolution_clock::now();
+                trimTime += std::chrono::duration_cast<std::chrono::nanoseconds>(endTime0 - startTime0).count();
+            }
+            idleFootprint = pool.getFootprint();
+
+            for (size_t i = 0; i < countAlive; ++i)
+            {
+                pool.freeMemory(ptrs[i]);
+            }
+        }
+        auto endTime = std::chrono::high_resolution_clock::now();
+
+        std::cout << " time (ms) " << (double)std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count() / 1000.0
+            << ", peak (MB) " << peakFootprint / (1024 * 1024) << ", idle (MB) " << idleFootprint / (1024 * 1024);
+        if (trim)
+        {
+            std::cout << ", trim per burst (us) " << (double)trimTime / 1000.0 / countBursts;
+        }
+        std::cout << std::endl;
+    };
+
+    //keeps empty pools and cached spans
+    {
+        mem::MemoryPool pool(g_pageSize, &g_allocator, false);
+        std::cout << "POOL retained:";
+        executeCallback(pool, false);
+    }
+
+    //releases empty pools on free
+    {
+        mem::MemoryPool pool(g_pageSize, &g_allocator, true);
+        std::cout << "POOL deleteUnusedPools:";
+        executeCallback(pool, false);
+    }
+
+    //trims at idle
+    {
+        mem::MemoryPool pool(g_pageSize, &g_allocator, false);
+        std::cout << "POOL trim at idle:";
+        executeCallback(pool, true);
+    }
+
+    //budget, trims on growth
+    {
+        struct BudgetState
+        {
+            mem::u64 _countCrossings = 0;
+            mem::u64 _maxFootprint = 0;
+        } state;
+
+        mem::MemoryPool pool(g_pageSize, &g_allocator, false);
+        pool.setMemoryBudget(budget, [](mem::MemoryPool* pool, mem::u64 footprint, mem::u64 budget, void* user) -> void
+            {
+                BudgetState* state = reinterpret_cast<BudgetState*>(user);
+                ++state->_countCrossings;
+                state->_maxFootprint = std::max(state->_maxFootprint, footprint);
+            }, &state);
+        std::cout << "POOL budget " << budget / (1024 * 1024) << "MB:";
+        executeCallback(pool, false);
+        std::cout << " budget crossings " << state._countCrossings << ", max requested footprint (MB) " << state._maxFootprint / (1024 * 1024) << std::endl;
+    }
+
+    //budget, large block grown by realloc
+    {
+        mem::u64 countCrossings = 0;
+        mem::MemoryPool pool(g_pageSize, &g_allocator, false);
+        pool.setMemoryBudget(4 * 1024 * 1024, [](mem::MemoryPool* pool, mem::u64 footprint, mem::u64 budget, void* user) -> void
+            {
+                ++*reinterpret_cast<mem::u64*>(user);
+            }, &countCrossings);
+
+        void* ptr = pool.allocMemory(1024 * 1024);
+        memset(ptr, 1, 1024 * 1024);
+        ptr = pool.reallocMemory(ptr, 8 * 1024 * 1024);
+        std::cout << "POOL budget realloc: budget crossings " << countCrossings << std::endl;
+        pool.freeMemory(ptr);
+        if (countCrossings == 0)
+        {
+            return false;
+        }
+    }
+
+    std::cout << "----------------Test_26 END" << std::endl;
+    return true;
+}
+
+bool Test_27()
+{
+    std::cout << "----------------Test_27 (Memory pressure monitor. Fake cgroup and PSI files)" << std::endl;
+
+    const std::string memoryCurrentPath = "./memory.current";
+    const std::string memoryHighPath = "./memory.high";
+    const std::string pressurePath = "./memory.pressure";
+    auto writeFiles = [&](mem::u64 current, mem::u64 high, double some, double full) -> void
+    {
+        std::ofstream(memoryCurrentPath) << current << std::endl;
+        std::ofstream(memoryHighPath) << high << std::endl;
+        std::ofstream(pressurePath) << "some avg10=" << some << " avg60=0.00 avg300=0.00 total=0" << std::endl
+            << "full avg10=" << full << " avg60=0.00 avg300=0.00 total=0" << std::endl;
+    };
+
+    const size_t countAllocations = 40000;
+    std::mt19937 gen(27);
+    std::uniform_int_distribution<size_t> dis(16, 8192);
+    std::vector<void*> ptrs(countAllocations);
+
+    mem::MemoryPool pool(g_pageSize, &g_allocator, false);
+    mem::MemoryPressureMonitor::Config config;
+    config._cgroupPath = "./";
+    config._pressurePath = pressurePath;
+    config._pollInterval = 1;
+    mem::MemoryPressureMonitor monitor(pool, config);
+
+    auto burst = [&]() -> void
+    {
+        for (size_t i = 0; i < countAllocations; ++i)
+        {
+            size_t size = (i % 1000 == 0) ? 1024 * 1024 : dis(gen);
+            ptrs[i] = pool.allocMemory(size);
+            memset(ptrs[i], 0, std::min<size_t>(size, 64));
+        }
+        for (void* ptr : ptrs)
+        {
+            pool.freeMemory(ptr);
+        }
+    };
+
+    auto step = [&](const char* name) -> void
+    {
+        mem::u64 footprint = pool.getFootprint();
+        monitor.sample();
+        auto startTime = std::chrono::high_resolution_clock::now();
+        mem::u64 releasedSize = monitor.update();
+        auto endTime = std::chrono::high_resolution_clock::now();
+        std::cout << name << ": pressure " << (mem::u32)monitor.getPressure() << ", footprint (MB) " << footprint / (1024 * 1024) << " -> " << pool.getFootprint() / (1024 * 1024)
+            << ", released (MB) " << releasedSize / (1024 * 1024) << ", update (us) " << (double)std::chrono::duration_cast<std::chrono::nanoseconds>(endTime - startTime).count() / 1000.0 << std::endl;
+    };
+
+    const mem::u64 high = 1024ULL * 1024 * 1024;
+
+    burst();
+    writeFiles(high / 2, high, 0.0, 0.0);
+    step("no pressure");
+
+    writeFiles(high - high / 20, high, 0.0, 0.0);
+    step("cgroup above watermark");
+
+    burst();
+    writeFiles(high / 2, high, 25.0, 0.0);
+    step("psi some");
+
+    burst();
+    writeFiles(high / 2, high, 25.0, 10.0);
+    step("psi full");
+
+    //background thread samples, the pool owner applies trims
+    {
+        writeFiles(high, high, 0.0, 0.0);
+        monitor.start();
+        auto startTime = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < 20; ++i)
+        {
+            burst();
+            monitor.update();
+        }
+        auto endTime = std::chrono::high_resolution_clock::now();
+        monitor.stop();
+        std::cout << "background, bursts with update (ms) " << (double)std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count() / 1000.0
+            << ", footprint (MB) " << pool.getFootprint() / (1024 * 1024) << std::endl;
+    }
+
+    mem::MemoryPressureMonitor::Statistic statistic = monitor.getStatistic();
+    std::cout << "samples " << statistic._countSamples << ", moderate " << statistic._countModerate << ", critical " << statistic._countCritical
+        << ", trims " << statistic._countTrims << ", released (MB) " << statistic._releasedSize / (1024 * 1024) << std::endl;
+
+    std::remove(memoryCurrentPath.c_str());
+    std::remove(memoryHighPath.c_str());
+    std::remove(pressurePath.c_str());
+
+    std::cout << "----------------Test_27 END" << std::endl;
+    return true;
+}
+
+bool Test_28()
+{
+    std::cout << "----------------Test_28 (Containers. PoolAllocator and PoolMemoryResource)" << std::endl;
+
+    const size_t countElements = 100000;
+    const size_t countRounds = 3;
+
+    std::mt19937 gen(28);
+    std::vector<mem::u64> keys(countElements);
+    for (mem::u64& key : keys)
+    {
+        key = gen();
+    }
+
+    //fill, look up, erase half, refill, clear
+    auto executeCallback = [&](auto createContainer) -> void
+    {
+        auto startTime = std::chrono::high_resolution_clock::now();
+        mem::u64 checksum = 0;
+        for (size_t round = 0; round < countRounds; ++round)
+        {
+            auto container = createContainer();
+            for (mem::u64 key : keys)
+            {
+                container.emplace(key, key);
+            }
+            for (mem::u64 key : keys)
+            {
+                checksum += container.find(key)->second;
+            }
+            for (size_t i = 0; i < countElements; i += 2)
+            {
+                container.erase(keys[i]);
+            }
+            for (size_t i = 0; i < countElements; i += 2)
+            {
+                container.emplace(keys[i], i);
+            }
+            checksum += container.size();
+        }
+        auto endTime = std::chrono::high_resolution_clock::now();
+        std::cout << " time (ms) " << (double)std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count() / 1000.0 << " (" << checksum % 1000 << ")" << std::endl;
+    };
+
+    //push, pop the half from the front, push again, splice
+    auto executeListCallback = [&](auto createContainer) -> void
+    {
+        auto startTime = std::chrono::high_resolution_clock::now();
+        mem::u64 checksum = 0;
+        for (size_t round = 0; round < countRounds; ++round)
+        {
+            auto container = createContainer();
+            for (mem::u64 key : keys)
+            {
+                container.push_back(key);
+            }
+            for (size_t i = 0; i < countElements / 2; ++i)
+            {
+                container.pop_front();
+            }
+            for (mem::u64 key : keys)
+            {
+                container.push_front(key);
+            }
+            for (mem::u64 value : container)
+            {
+                checksum += value;
+            }
+        }
+        auto endTime = std::chrono::high_resolution_clock::now();
+        std::cout << " time (ms) " << (double)std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count() / 1000.0 << " (" << checksum % 1000 << ")" << std::endl;
+    };
+
+    using Pair = std::pair<const mem::u64, mem::u64>;
+    mem::MemoryPool pool(g_pageSize, &g_allocator);
+    mem::PoolAllocator<Pair> allocator(pool);
+
+    //std::map
+    {
+        std::cout << "STD std::map:";
+        executeCallback([]() { return std::map<mem::u64, mem::u64>(); });
+
+        std::cout << "POOL std::map:";
+        executeCallback([&allocator]() { return std::map<mem::u64, mem::u64, std::less<mem::u64>, mem::PoolAllocator<Pair>>(allocator); });
+    }
+
+    //std::list
+    {
+        std::cout << "STD std::list:";
+        executeListCallback([]() { return std::list<mem::u64>(); });
+
+        std::cout << "POOL std::list:";
+        executeListCallback([&pool]() { return std::list<mem::u64, mem::PoolAllocator<mem::u64>>(mem::PoolAllocator<mem::u64>(pool)); });
+    }
+
+    //std::unordered_map
+    {
+        std::cout << "STD std::unordered_map:";
+        executeCallback([]() { return std::unordered_map<mem::u64, mem::u64>(); });
+
+        std::cout << "POOL std::unordered_map:";
+        executeCallback([&allocator]() { return std::unordered_map<mem::u64, mem::u64, std::hash<mem::u64>, std::equal_to<mem::u64>, mem::PoolAllocator<Pair>>(0, allocator); });
+    }
+
+#if MEMORY_POOL_RESOURCE
+    //std::pmr
+    {
+        mem::PoolMemoryResource resource(pool);
+
+        std::cout << "STD std::pmr::map new_delete_resource:";
+        executeCallback([]() { return std::pmr::map<mem::u64, mem::u64>(std::pmr::new_delete_resource()); });
+
+        std::cout << "STD std::pmr::map unsynchronized_pool_resource:";
+        {
+            std::pmr::unsynchronized_pool_resource poolResource;
+            executeCallback([&poolResource]() { return std::pmr::map<mem::u64, mem::u64>(&poolResource); });
+        }
+
+        std::cout << "POOL std::pmr::map:";
+        executeCallback([&resource]() { return std::pmr::map<mem::u64, mem::u64>(&resource); });
+
+        std::cout << "POOL std::pmr::list:";
+        executeListCallback([&resource]() { return std::pmr::list<mem::u64>(&resource); });
+
+        std::cout << "POOL std::pmr::unordered_map:";
+        executeCallback([&resource]() { return std::pmr::unordered_map<mem::u64, mem::u64>(&resource); });
+    }
+#endif //MEMORY_POOL_RESOURCE
+
+    std::cout << "----------------Test_28 END" << std::endl;
+    return true;
+}
+
+bool Test_29()
+{
+    std::cout << "----------------Test_29 (ObjectPool. Entities and messages)" << std::endl;
+
+    //constructor initializes the components, cached objects keep them
+    struct Entity
+    {
+        Entity() noexcept
+            : _id(0)
+        {
+            for (size_t i = 0; i < 16; ++i)
+            {
+                _transform[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+            }
+        }
+
+        mem::u64    _id;
+        float       _transform[16];
+    };
+
+    struct Message
+    {
+        Message(mem::u64 type, mem::u64 payload) noexcept
+            : _type(type)
+            , _payload(payload)
+        {
+        }
+
+        mem::u64 _type;
+        mem::u64 _payload;
+        mem::u64 _data[4];
+    };
+
+    const size_t countObjects = 100000;
+    const size_t countRounds = 20;
+    std::vector<Entity*> entities(countObjects);
+    std::vector<Message*> messages(countObjects);
+
+    auto executeCallback = [&](std::function<Entity*(void)> createEntity, std::function<void(Entity*)> destroyEntity,
+        std::function<Message*(mem::u64)> createMessage, std::function<void(Message*)> destroyMessage) -> void
+    {
+        mem::u64 checksum = 0;
+        auto startTime = std::chrono::high_resolution_clock::now();
+        for (size_t round = 0; round < countRounds; ++round)
+        {
+            for (size_t i = 0; i < countObjects; ++i)
+            {
+                entities[i] = createEntity();
+                entities[i]->_id = i;
+                messages[i] = createMessage(i);
+            }
+            for (size_t i = 0; i < countObjects; ++i)
+            {
+                checksum += entities[i]->_id + messages[i]->_payload;
+                destroyMessage(messages[i]);
+                destroyEntity(entities[i]);
+            }
+        }
+        auto endTime = std::chrono::high_resolution_clock::now();
+        std::cout << " time (ms) " << (double)std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count() / 1000.0 << " (" << checksum % 1000 << ")" << std::endl;
+    };
+
+    //new/delete
+    {
+        std::cout << "STD new/delete:";
+        executeCallback([]() -> Entity* { return new Entity(); }, [](Entity* entity) -> void { delete entity; },
+            [](mem::u64 i) -> Message* { return new Message(1, i); }, [](Message* message) -> void { delete message; });
+    }
+
+    //allocMemory, runtime size class
+    {
+        mem::MemoryPool pool(g_pageSize, &g_allocator);
+        std::cout << "POOL allocMemory:";
+        executeCallback([&pool]() -> Entity* { return new(pool.allocMemory(sizeof(Entity), alignof(Entity))) Entity(); }, [&pool](Entity* entity) -> void { entity->~Entity(); pool.freeMemory(entity); },
+            [&pool](mem::u64 i) -> Message* { return new(pool.allocMemory(sizeof(Message), alignof(Message))) Message(1, i); }, [&pool](Message* message) -> void { message->~Message(); pool.freeMemory(message); });
+    }
+
+    //ObjectPool, compile time size class
+    {
+        mem::MemoryPool pool(g_pageSize, &g_allocator);
+        mem::ObjectPool<Entity> entityPool(pool);
+        mem::ObjectPool<Message> messagePool(pool);
+        std::cout << "POOL ObjectPool:";
+        executeCallback([&entityPool]() -> Entity* { return entityPool.create(); }, [&entityPool](Entity* entity) -> void { entityPool.destroy(entity); },
+            [&messagePool](mem::u64 i) -> Message* { return messagePool.create(1, i); }, [&messagePool](Message* message) -> void { messagePool.destroy(message); });
+    }
+
+    //ObjectPool with object caching, entities are not constructed again
+    {
+        mem::MemoryPool pool(g_pageSize, &g_allocator);
+        mem::ObjectPool<Entity> entityPool(pool, static_cast<mem::u32>(countObjects));
+        mem::ObjectPool<Message> messagePool(pool);
+        std::cout << "POOL ObjectPool cached:";
+        executeCallback([&entityPool]() -> Entity* { return entityPool.acquire(); }, [&entityPool](Entity* entity) -> void { entityPool.release(entity); },
+            [&messagePool](mem::u64 i) -> Message* { return messagePool.create(1, i); }, [&messagePool](Message* message) -> void { messagePool.destroy(message); });
+    }
+
+    std::cout << "----------------Test_29 END" << std::endl;
+    return true;
+}
+
+bool Test_30()
+{
+    std::cout << "----------------Test_30 (Medium allocation. Size classes and coalescing)" << std::endl;
+
+    //medium requests are bigger than the small tables, up to a page
+    const size_t minSize = 32'768 + 16;
+    const size_t maxSize = g_pageSize;
+
+    //sizes around the first and second level bucket boundaries of the free block index
+    std::vector<size_t> sizes;
+    for (size_t firstLevel = 32'768; firstLevel <= maxSize; firstLevel <<= 1)
+    {
+        for (size_t secondLevel = 0; secondLevel < 16; ++secondLevel)
+        {
+            size_t boundary = firstLevel + secondLevel * (firstLevel / 16);
+            for (size_t size : { boundary - 16, boundary - 1, boundary, boundary + 1, boundary + 16 })
+            {
+                if (size >= minSize && size <= maxSize)
+                {
+                    sizes.push_back(size);
+                }
+            }
+        }
+    }
+    sizes.push_back(maxSize);
+
+    //every size is served, live blocks don't overlap
+    {
+        mem::MemoryPool pool(g_pageSize, &g_allocator, false);
+        std::vector<void*> ptrs(sizes.size());
+        for (size_t i = 0; i < sizes.size(); ++i)
+        {
+            ptrs[i] = pool.allocMemory(sizes[i]);
+            if (!ptrs[i] || reinterpret_cast<mem::u64>(ptrs[i]) % alignof(std::max_align_t) != 0)
+            {
+                return false;
+            }
+            memset(ptrs[i], (int)i, sizes[i]);
+        }
+
+        std::vector<unsigned char> expected(maxSize);
+        for (size_t i = 0; i < sizes.size(); ++i)
+        {
+            memset(expected.data(), (int)i, sizes[i]);
+            if (memcmp(ptrs[i], expected.data(), sizes[i]) != 0)
+            {
+                return false;
+            }
+            pool.freeMemory(ptrs[i]);
+        }
+    }
+
+    //count of blocks of the size sequence a single pool holds
+    auto countPerPool = [](const std::vector<size_t>& sequence) -> size_t
+    {
+        mem::MemoryPool pool(g_pageSize, &g_allocator, false);
+        std::vector<void*> ptrs;
+        while (pool.getMediumFragmentation().size() < 2)
+        {
+            ptrs.push_back(pool.allocMemory(sequence[ptrs.size() % sequence.size()]));
+        }
+        for (void* ptr : ptrs)
+        {
+            pool.freeMemory(ptr);
+        }
+        return ptrs.size() - 1;
+    };
+
+    const std::vector<size_t> maxSizes = { maxSize };
+    const size_t countMaxBlocks = countPerPool(maxSizes);
+    const size_t countBlocks = countPerPool(sizes);
+
+    //freed neighbours must merge back to a single free block covering the pool
+    auto fillAndFree = [&](mem::MemoryPool& pool, std::function<void(std::vector<void*>&)> order) -> bool
+    {
+        std::vector<void*> ptrs(countBlocks);
+        for (size_t i = 0; i < countBlocks; ++i)
+        {
+            ptrs[i] = pool.allocMemory(sizes[i % sizes.size()]);
+        }
+        if (pool.getMediumFragmentation().size() != 1)
+        {
+            return false;
+        }
+
+        order(ptrs);
+        for (void* ptr : ptrs)
+        {
+            pool.freeMemory(ptr);
+        }
+
+        //a pool of fragments can't hold all max size blocks without a new pool
+        std::vector<void*> maxPtrs(countMaxBlocks);
+        for (size_t i = 0; i < countMaxBlocks; ++i)
+        {
+            maxPtrs[i] = pool.allocMemory(maxSize);
+        }
+        bool merged = pool.getMediumFragmentation().size() == 1;
+        for (void* ptr : maxPtrs)
+        {
+            pool.freeMemory(ptr);
+        }
+
+        return merged;
+    };
+
+    {
+        mem::MemoryPool pool(g_pageSize, &g_allocator, false);
+        std::mt19937 gen(30);
+
+        //evens first, every odd block merges with both neighbours
+        bool interleaved = fillAndFree(pool, [](std::vector<void*>& ptrs) -> void
+            {
+                std::vector<void*> order;
+                for (size_t i = 0; i < ptrs.size(); i += 2)
+                {
+                    order.push_back(ptrs[i]);
+                }
+                for (size_t i = 1; i < ptrs.size(); i += 2)
+                {
+                    order.push_back(ptrs[i]);
+                }
+                ptrs = order;
+            });
+        bool reversed = fillAndFree(pool, [](std::vector<void*>& ptrs) -> void { std::reverse(ptrs.begin(), ptrs.end()); });
+        bool shuffled = fillAndFree(pool, [&gen](std::vector<void*>& ptrs) -> void { std::shuffle(ptrs.begin(), ptrs.end(), gen); });
+
+        std::cout << "POOL coalescing: blocks per pool " << countBlocks << ", max size blocks " << countMaxBlocks
+            << ". Interleaved " << interleaved << ", reversed " << reversed << ", shuffled " << shuffled << std::endl;
+        if (!interleaved || !reversed || !shuffled)
+        {
+            return false;
+        }
+    }
+
+    //realloc grows into the freed next block and keeps the content
+    {
+        mem::MemoryPool pool(g_pageSize, &g_allocator, false);
+        void* first = pool.allocMemory(minSize);
+        void* second = pool.allocMemory(minSize);
+        void* third = pool.allocMemory(minSize);
+        memset(first, 0x5a, minSize);
+        pool.freeMemory(second);
+
+        const size_t grownSize = minSize + minSize / 2;
+        void* grown = pool.reallocMemory(first, grownSize);
+        std::vector<unsigned char> expected(minSize, 0x5a);
+        if (grown != first || memcmp(grown, expected.data(), minSize) != 0)
+        {
+            return false;
+        }
+        memset(grown, 0x5a, grownSize);
+
+        pool.freeMemory(grown);
+        pool.freeMemory(third);
+    }
+
+    std::cout << "----------------Test_30 END" << std::endl;
+    return true;
+}
+
+int main()
+{
+#ifdef WIN32
+    SYSTEM_INFO systemInfo;
+    memset(&systemInfo, 0, sizeof(SYSTEM_INFO));
+    ::GetSystemInfo(&systemInfo);
+
+    g_pageSize = std::max<mem::u64>(mem::MemoryPool::k_mixSizePageSize, systemInfo.dwAllocationGranularity);
+#endif //WIN32
+
+#if __ANDROID__
+    android_log::start_logger("MemoryPool Test");
+
+    g_pageSize = std::max<mem::u64>(mem::MemoryPool::k_mixSizePageSize, (mem::u64)sysconf(_SC_PAGESIZE));
+#endif //__ANDROID__
+
+#if defined(__linux__) && !defined(__ANDROID__)
+    g_pageSize = std::max<mem::u64>(mem::MemoryPool::k_mixSizePageSize, (mem::u64)sysconf(_SC_PAGESIZE));
+#endif //__linux__
     std::cout << "PaseSize : " << g_pageSize << std::endl;
 
     TEST(Test_0());
@@ -1159,6 +3262,27 @@ int main()
     TEST(Test_7());
     //TEST(Test_8());
     TEST(Test_9());
+    TEST(Test_10());
+    TEST(Test_11());
+    TEST(Test_12());
+    TEST(Test_13());
+    TEST(Test_14());
+    TEST(Test_15());
+    TEST(Test_16());
+    TEST(Test_17());
+    TEST(Test_18());
+    TEST(Test_19());
+    TEST(Test_20());
+    TEST(Test_21());
+    TEST(Test_22());
+    TEST(Test_23());
+    TEST(Test_24());
+    TEST(Test_25());
+    TEST(Test_26());
+    TEST(Test_27());
+    TEST(Test_28());
+    TEST(Test_29());
+    TEST(Test_30());
 
     std::cout << "TEST END : " << std::endl;
     return 0;